@@ -0,0 +1,196 @@
+// Headless world generation benchmark: generates chunks for a seed without a window or a GL context and reports the
+// generation throughput, how many items fit in a chunk, the size of its merged static mesh and how many allocations a
+// chunk costs. Generating a chunk includes baking its static mesh, like on the game's worker threads.
+//
+// Usage: world_bench [--seed N] [--chunks N]
+
+#include "world.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Every allocation of the process goes through these, so the counts include the vectors of the chunks. The aligned
+// and array forms are replaced as well, and all of them release through the same function.
+std::atomic<uint64_t> allocationCount{0};
+std::atomic<uint64_t> allocatedBytes{0};
+
+static void *countedAllocate(size_t size, size_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    size = size == 0 ? 1 : size;
+#if defined(_WIN32)
+    void *memory = alignment > alignof(std::max_align_t) ? _aligned_malloc(size, alignment) : malloc(size);
+#else
+    // aligned_alloc takes a multiple of the alignment
+    void *memory = alignment > alignof(std::max_align_t)
+                   ? aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : malloc(size);
+#endif
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+static void countedRelease(void *memory, size_t alignment) noexcept {
+#if defined(_WIN32)
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(memory);
+        return;
+    }
+#endif
+    (void) alignment;
+    free(memory);
+}
+
+void *operator new(size_t size) { return countedAllocate(size, alignof(std::max_align_t)); }
+
+void *operator new[](size_t size) { return countedAllocate(size, alignof(std::max_align_t)); }
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *memory) noexcept { countedRelease(memory, alignof(std::max_align_t)); }
+
+void operator delete[](void *memory) noexcept { countedRelease(memory, alignof(std::max_align_t)); }
+
+void operator delete(void *memory, size_t) noexcept { countedRelease(memory, alignof(std::max_align_t)); }
+
+void operator delete[](void *memory, size_t) noexcept { countedRelease(memory, alignof(std::max_align_t)); }
+
+void operator delete(void *memory, std::align_val_t alignment) noexcept {
+    countedRelease(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void *memory, std::align_val_t alignment) noexcept {
+    countedRelease(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *memory, size_t, std::align_val_t alignment) noexcept {
+    countedRelease(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void *memory, size_t, std::align_val_t alignment) noexcept {
+    countedRelease(memory, static_cast<size_t>(alignment));
+}
+
+const char *ITEM_TYPE_NAMES[WorldChunk::ITEM_TYPE_COUNT] = {"random tree", "small tree", "big tree", "bush", "rock",
+                                                            "rabbit", "squirrel"};
+
+int main(int argc, char *argv[]) {
+    uint64_t seed = getWorldSeed();
+    int chunkCount = 200;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--chunks") == 0) {
+            chunkCount = std::max(atoi(argv[++i]), 1);
+        }
+    }
+    setWorldSeed(seed);
+
+    // The same chunks the game would stream in around the start position, nearest first
+    int radius = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(chunkCount)) / 2.0));
+    vector<ChunkCoord> chunks = chunkSpiral(radius);
+    chunks.resize(chunkCount);
+
+    uint64_t itemCount = 0;
+    uint64_t partCount = 0;
+    uint64_t staticVertexCount = 0;
+    uint64_t staticIndexCount = 0;
+    uint64_t propCount = 0;
+    uint64_t impostorCount = 0;
+    uint64_t levelIndexCounts[PROP_LOD_COUNT] = {};
+    uint64_t candidateCount = 0;
+    double biomeShares[BIOME_COUNT] = {};
+    uint64_t targets[WorldChunk::ITEM_TYPE_COUNT] = {};
+    uint64_t shortfalls[WorldChunk::ITEM_TYPE_COUNT] = {};
+
+    // Every impostor atlas is baked once per run by the first chunk that needs it, timed apart from the chunks
+    ImpostorLibrary &impostors = WorldChunk::treeImpostors();
+    auto bakeStart = std::chrono::steady_clock::now();
+    for (uint32_t archetype = 0; archetype < impostors.count(); archetype++) {
+        impostors.bake(archetype);
+    }
+    double bakeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - bakeStart).count();
+
+    uint64_t allocationsBefore = allocationCount.load();
+    uint64_t bytesBefore = allocatedBytes.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto &chunkID: chunks) {
+        WorldChunk chunk(chunkID);
+        chunk.bakeStaticMesh();
+        for (int type = 0; type < WorldChunk::ITEM_TYPE_COUNT; type++) {
+            itemCount += chunk.items[type].count();
+            targets[type] += chunk.placementTargets[type];
+            shortfalls[type] += chunk.placementShortfalls[type];
+        }
+        candidateCount += chunk.placementCandidates;
+        for (int biome = 0; biome < BIOME_COUNT; biome++) {
+            biomeShares[biome] += chunk.biomeShares[biome];
+        }
+        partCount += chunk.parts.size();
+        staticVertexCount += chunk.staticMesh.vertices.size();
+        staticIndexCount += chunk.staticMesh.indices.size();
+        propCount += chunk.staticMesh.props.count();
+        impostorCount += chunk.impostors.size();
+        for (int level = 0; level < PROP_LOD_COUNT; level++) {
+            const vector<uint32_t> &firstIndex = chunk.staticMesh.props.firstIndex[level];
+            levelIndexCounts[level] += firstIndex.back() - firstIndex.front();
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = allocationCount.load() - allocationsBefore;
+    uint64_t bytes = allocatedBytes.load() - bytesBefore;
+
+    printf("seed                %llu\n", static_cast<unsigned long long>(seed));
+    printf("chunks              %d in %.3f s\n", chunkCount, seconds);
+    printf("chunks/sec          %.1f\n", chunkCount / seconds);
+    printf("items/sec           %.1f (%.1f items per chunk)\n", itemCount / seconds,
+           static_cast<double>(itemCount) / chunkCount);
+    printf("parts per chunk     %.1f\n", static_cast<double>(partCount) / chunkCount);
+    printf("static mesh         %.0f vertices, %.0f triangles, %.1f KiB per chunk\n",
+           static_cast<double>(staticVertexCount) / chunkCount, static_cast<double>(staticIndexCount) / 3 / chunkCount,
+           static_cast<double>(staticVertexCount * sizeof(StaticVertex) + staticIndexCount * sizeof(uint32_t)) /
+           chunkCount / 1024.0);
+    printf("props per chunk     %.1f, triangles per level of detail", static_cast<double>(propCount) / chunkCount);
+    for (uint64_t levelIndexCount: levelIndexCounts) {
+        printf(" %.0f", static_cast<double>(levelIndexCount) / 3 / chunkCount);
+    }
+    printf("\n");
+    printf("impostors           %.1f per chunk, %u atlases baked in %.3f s\n",
+           static_cast<double>(impostorCount) / chunkCount, impostors.count(), bakeSeconds);
+    printf("allocations         %llu (%.1f per chunk, %.1f KiB per chunk)\n",
+           static_cast<unsigned long long>(allocations), static_cast<double>(allocations) / chunkCount,
+           static_cast<double>(bytes) / chunkCount / 1024.0);
+
+    printf("biomes             ");
+    for (int biome = 0; biome < BIOME_COUNT; biome++) {
+        printf(" %s %.0f%%", BIOMES[biome].name, 100.0 * biomeShares[biome] / chunkCount);
+    }
+    printf("\n");
+    printf("placement           %.1f candidates per chunk\n", static_cast<double>(candidateCount) / chunkCount);
+    for (int type = 0; type < WorldChunk::ITEM_TYPE_COUNT; type++) {
+        if (targets[type] == 0) {
+            continue;
+        }
+        printf("  %-16s  %llu of %llu placed (%.1f%% short)\n", ITEM_TYPE_NAMES[type],
+               static_cast<unsigned long long>(targets[type] - shortfalls[type]),
+               static_cast<unsigned long long>(targets[type]),
+               100.0 * static_cast<double>(shortfalls[type]) / static_cast<double>(targets[type]));
+    }
+
+    return 0;
+}
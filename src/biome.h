@@ -0,0 +1,202 @@
+#ifndef PROCEDURALWORLD_BIOME_H
+#define PROCEDURALWORLD_BIOME_H
+
+#include "terrain.h"
+#include "world_random.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace glm;
+using namespace std;
+
+// Biomes decide how many items of each type a region gets and the colors of its plants. Two low frequency noise
+// fields (temperature and moisture) give every world position a climate, and every biome is strongest around its own
+// climate. Where two biomes meet their weights blend smoothly, so item mixes and colors change gradually over several
+// chunks instead of at chunk borders.
+
+enum BiomeID {
+    BIOME_WOODLAND, BIOME_MEADOW, BIOME_PINE_FOREST, BIOME_AUTUMN_GROVE, BIOME_COUNT
+};
+
+// Same order as WorldChunk::itemType
+const int BIOME_ITEM_TYPE_COUNT = 7;
+
+struct Biome {
+    const char *name;
+    vec2 climate;                                // Temperature and moisture where the biome is strongest
+    float itemsPerChunk[BIOME_ITEM_TYPE_COUNT];  // Items of every type wanted in a 100x100 chunk
+    vec3 leafColors[6];                          // Leaves of the big trees, picked by the item's colorID
+    vec3 foliageColor;                           // Leaves of the small and random trees
+    vec3 bushColor;
+};
+
+const Biome BIOMES[BIOME_COUNT] = {
+        // Random tree, small tree, big tree, bush, rock, rabbit, squirrel
+        {"woodland", vec2(0.5f, 0.5f), {9, 10, 18, 10, 0, 5, 10},
+                {vec3(0.0f, 1.0f, 0.0f),         // Green
+                 vec3(0.545f, 0.573f, 0.086f),   // Dark yellow
+                 vec3(0.655f, 0.624f, 0.059f),   // Light gold
+                 vec3(0.545f, 0.573f, 0.086f),   // Marigold
+                 vec3(0.914f, 0.525f, 0.016f),   // Fulvous
+                 vec3(0.875f, 0.224f, 0.031f)},  // Sinopia
+                vec3(0.0f, 1.0f, 0.0f), vec3(0.0f, 1.0f, 0.5f)},
+        {"meadow", vec2(0.75f, 0.3f), {2, 4, 3, 22, 0, 12, 4},
+                {vec3(0.45f, 0.85f, 0.1f), vec3(0.6f, 0.85f, 0.15f), vec3(0.75f, 0.8f, 0.2f),
+                 vec3(0.5f, 0.75f, 0.05f), vec3(0.85f, 0.8f, 0.3f), vec3(0.4f, 0.7f, 0.1f)},
+                vec3(0.45f, 0.8f, 0.1f), vec3(0.55f, 0.85f, 0.2f)},
+        {"pine forest", vec2(0.2f, 0.7f), {14, 8, 24, 4, 0, 2, 14},
+                {vec3(0.05f, 0.45f, 0.15f), vec3(0.1f, 0.4f, 0.2f), vec3(0.05f, 0.35f, 0.1f),
+                 vec3(0.15f, 0.5f, 0.25f), vec3(0.1f, 0.3f, 0.15f), vec3(0.2f, 0.45f, 0.2f)},
+                vec3(0.05f, 0.45f, 0.15f), vec3(0.1f, 0.5f, 0.3f)},
+        {"autumn grove", vec2(0.35f, 0.25f), {10, 12, 14, 8, 0, 6, 12},
+                {vec3(0.914f, 0.525f, 0.016f), vec3(0.875f, 0.224f, 0.031f), vec3(0.8f, 0.35f, 0.05f),
+                 vec3(0.95f, 0.7f, 0.1f), vec3(0.6f, 0.15f, 0.05f), vec3(0.85f, 0.45f, 0.1f)},
+                vec3(0.85f, 0.45f, 0.05f), vec3(0.7f, 0.35f, 0.1f)}};
+
+const float BIOME_FREQUENCY = 1.0f / 400.0f; // Climate changes over about four chunks
+const float BIOME_RADIUS = 0.45f;            // Climate distance at which a biome fades out completely
+
+// Samples per side of the grid that biomes are evaluated on, a whole chunk at once
+const int BIOME_GRID_SIZE = 8;
+const int BIOME_SAMPLE_COUNT = BIOME_GRID_SIZE * BIOME_GRID_SIZE;
+
+// Biome weights and item densities over one chunk, on a BIOME_GRID_SIZE^2 grid of cell centers. Values between the
+// samples are interpolated.
+struct ChunkBiomes {
+    float minX = 0.0f;
+    float minZ = 0.0f;
+    float size = 100.0f;
+
+    float weights[BIOME_COUNT][BIOME_SAMPLE_COUNT] = {};             // Sum to 1 at every sample
+    float densities[BIOME_ITEM_TYPE_COUNT][BIOME_SAMPLE_COUNT] = {}; // Items per chunk at every sample
+
+    // Blended items per chunk of a type, averaged over the whole chunk
+    [[nodiscard]] float itemsPerChunk(int type) const {
+        float sum = 0.0f;
+        for (int i = 0; i < BIOME_SAMPLE_COUNT; i++) {
+            sum += densities[type][i];
+        }
+        return sum / BIOME_SAMPLE_COUNT;
+    }
+
+    // Average weight of a biome over the chunk
+    [[nodiscard]] float share(int biome) const {
+        float sum = 0.0f;
+        for (int i = 0; i < BIOME_SAMPLE_COUNT; i++) {
+            sum += weights[biome][i];
+        }
+        return sum / BIOME_SAMPLE_COUNT;
+    }
+
+    [[nodiscard]] float densityAt(int type, float x, float z) const {
+        return sampleAt(densities[type], x, z);
+    }
+
+    [[nodiscard]] float weightAt(int biome, float x, float z) const {
+        return sampleAt(weights[biome], x, z);
+    }
+
+    [[nodiscard]] vec3 leafColorAt(float x, float z, int colorID) const {
+        vec3 color(0.0f);
+        for (int biome = 0; biome < BIOME_COUNT; biome++) {
+            color += weightAt(biome, x, z) * BIOMES[biome].leafColors[colorID];
+        }
+        return color;
+    }
+
+    [[nodiscard]] vec3 foliageColorAt(float x, float z) const {
+        vec3 color(0.0f);
+        for (int biome = 0; biome < BIOME_COUNT; biome++) {
+            color += weightAt(biome, x, z) * BIOMES[biome].foliageColor;
+        }
+        return color;
+    }
+
+    [[nodiscard]] vec3 bushColorAt(float x, float z) const {
+        vec3 color(0.0f);
+        for (int biome = 0; biome < BIOME_COUNT; biome++) {
+            color += weightAt(biome, x, z) * BIOMES[biome].bushColor;
+        }
+        return color;
+    }
+
+private:
+    // Bilinear interpolation between the cell centers, clamped to the grid
+    [[nodiscard]] float sampleAt(const float *grid, float x, float z) const {
+        float cell = size / BIOME_GRID_SIZE;
+        float gridX = glm::clamp((x - minX) / cell - 0.5f, 0.0f, BIOME_GRID_SIZE - 1.0f);
+        float gridZ = glm::clamp((z - minZ) / cell - 0.5f, 0.0f, BIOME_GRID_SIZE - 1.0f);
+        int i = std::min(static_cast<int>(gridX), BIOME_GRID_SIZE - 2);
+        int j = std::min(static_cast<int>(gridZ), BIOME_GRID_SIZE - 2);
+        float tx = gridX - i;
+        float tz = gridZ - j;
+
+        float near = mix(grid[j * BIOME_GRID_SIZE + i], grid[j * BIOME_GRID_SIZE + i + 1], tx);
+        float far = mix(grid[(j + 1) * BIOME_GRID_SIZE + i], grid[(j + 1) * BIOME_GRID_SIZE + i + 1], tx);
+        return mix(near, far, tz);
+    }
+};
+
+// Evaluates the biomes of the area [minX, minX + size] x [minZ, minZ + size]. Every step runs over all samples of the
+// chunk at once in plain loops over arrays, which the compiler turns into SIMD code; nothing is evaluated per item.
+inline ChunkBiomes evaluateChunkBiomes(float minX, float minZ, float size) {
+    ChunkBiomes biomes;
+    biomes.minX = minX;
+    biomes.minZ = minZ;
+    biomes.size = size;
+
+    uint64_t temperatureSeed = splitMix64(getWorldSeed() ^ 0x74656d70ull); // Separate from terrain and items
+    uint64_t moistureSeed = splitMix64(getWorldSeed() ^ 0x6d6f6973ull);
+
+    float temperature[BIOME_SAMPLE_COUNT];
+    float moisture[BIOME_SAMPLE_COUNT];
+    float cell = size / BIOME_GRID_SIZE;
+    for (int i = 0; i < BIOME_SAMPLE_COUNT; i++) {
+        float x = (minX + (static_cast<float>(i % BIOME_GRID_SIZE) + 0.5f) * cell) * BIOME_FREQUENCY;
+        float z = (minZ + (static_cast<float>(i / BIOME_GRID_SIZE) + 0.5f) * cell) * BIOME_FREQUENCY;
+        temperature[i] = terrainValueNoise(x, z, temperatureSeed);
+        moisture[i] = terrainValueNoise(x, z, moistureSeed);
+    }
+
+    // Value noise stays close to 0.5, the climate is stretched so that every biome gets its share
+    for (int i = 0; i < BIOME_SAMPLE_COUNT; i++) {
+        temperature[i] = glm::clamp((temperature[i] - 0.5f) * 1.8f + 0.5f, 0.0f, 1.0f);
+        moisture[i] = glm::clamp((moisture[i] - 0.5f) * 1.8f + 0.5f, 0.0f, 1.0f);
+    }
+
+    // Smooth falloff around each biome's climate, then normalized so the weights sum to 1
+    float total[BIOME_SAMPLE_COUNT] = {};
+    for (int biome = 0; biome < BIOME_COUNT; biome++) {
+        vec2 center = BIOMES[biome].climate;
+        float *weight = biomes.weights[biome];
+        for (int i = 0; i < BIOME_SAMPLE_COUNT; i++) {
+            float dt = temperature[i] - center.x;
+            float dm = moisture[i] - center.y;
+            float falloff = std::max(1.0f - (dt * dt + dm * dm) * (1.0f / (BIOME_RADIUS * BIOME_RADIUS)), 0.0f);
+            weight[i] = falloff * falloff + 1e-4f; // Never all zero
+            total[i] += weight[i];
+        }
+    }
+    for (int biome = 0; biome < BIOME_COUNT; biome++) {
+        for (int i = 0; i < BIOME_SAMPLE_COUNT; i++) {
+            biomes.weights[biome][i] /= total[i];
+        }
+    }
+
+    for (int type = 0; type < BIOME_ITEM_TYPE_COUNT; type++) {
+        float *density = biomes.densities[type];
+        for (int biome = 0; biome < BIOME_COUNT; biome++) {
+            float itemsPerChunk = BIOMES[biome].itemsPerChunk[type];
+            const float *weight = biomes.weights[biome];
+            for (int i = 0; i < BIOME_SAMPLE_COUNT; i++) {
+                density[i] += weight[i] * itemsPerChunk;
+            }
+        }
+    }
+
+    return biomes;
+}
+
+#endif //PROCEDURALWORLD_BIOME_H
@@ -0,0 +1,180 @@
+#ifndef PROCEDURALWORLD_CHUNK_CACHE_H
+#define PROCEDURALWORLD_CHUNK_CACHE_H
+
+#include "chunk_coord.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Holds a bounded number of generated chunks. When the budget is full the least recently used chunk is evicted,
+// a chunk that is needed again later has to be generated again (the world seed makes it identical).
+//
+// Chunks live in one contiguous array of slots and never move while they are cached, so the pointers returned by
+// find() can be used to read a chunk in place. Slots are found through a ring indexed by the chunk's coordinate hash:
+// neighbouring chunks along z land in neighbouring ring positions and a lookup is usually a single probe.
+template<class Chunk>
+class ChunkCache {
+public:
+    // The capacity is at least one chunk, insert() always needs a slot to put the new chunk in
+    explicit ChunkCache(size_t capacity) {
+        resize(std::max<size_t>(capacity, 1));
+    }
+
+    [[nodiscard]] bool contains(ChunkCoord chunkID) const {
+        return findSlot(chunkID) != NO_SLOT;
+    }
+
+    // Read-only view of a cached chunk, nullptr if it isn't cached. Does not count as a use.
+    [[nodiscard]] const Chunk *find(ChunkCoord chunkID) const {
+        int32_t slot = findSlot(chunkID);
+        return slot == NO_SLOT ? nullptr : &*slots[slot].chunk;
+    }
+
+    // Marks the chunk as recently used so it is kept, returns false when it is not in the cache
+    bool touch(ChunkCoord chunkID) {
+        int32_t slot = findSlot(chunkID);
+        if (slot == NO_SLOT) {
+            return false;
+        }
+        slots[slot].lastUsed = ++useCounter;
+        return true;
+    }
+
+    void insert(ChunkCoord chunkID, Chunk &&chunk) {
+        if (touch(chunkID)) {
+            return;
+        }
+
+        int32_t slot;
+        if (cachedCount < slots.size()) {
+            slot = static_cast<int32_t>(cachedCount++);
+        } else {
+            slot = leastRecentlyUsedSlot();
+            removeFromRing(slot);
+            evictionCount++;
+        }
+
+        slots[slot].chunkID = chunkID;
+        slots[slot].lastUsed = ++useCounter;
+        slots[slot].chunk.emplace(std::move(chunk));
+        addToRing(slot);
+    }
+
+    // Keeps the most recently used chunks that fit in the new capacity, which is at least one chunk
+    void setCapacity(size_t newCapacity) {
+        newCapacity = std::max<size_t>(newCapacity, 1);
+        vector<Slot> kept(std::make_move_iterator(slots.begin()),
+                          std::make_move_iterator(slots.begin() + cachedCount));
+        sort(kept.begin(), kept.end(), [](const Slot &a, const Slot &b) { return a.lastUsed > b.lastUsed; });
+        if (kept.size() > newCapacity) {
+            evictionCount += kept.size() - newCapacity;
+            kept.resize(newCapacity);
+        }
+
+        resize(newCapacity);
+        for (auto &slot: kept) {
+            slots[cachedCount] = std::move(slot);
+            addToRing(static_cast<int32_t>(cachedCount++));
+        }
+    }
+
+    // Evicts every chunk
+    void clear() {
+        evictionCount += cachedCount;
+        resize(slots.size());
+    }
+
+    [[nodiscard]] size_t size() const { return cachedCount; }
+
+    [[nodiscard]] size_t getCapacity() const { return slots.size(); }
+
+    [[nodiscard]] size_t getEvictionCount() const { return evictionCount; }
+
+private:
+    static constexpr int32_t NO_SLOT = -1;
+
+    struct Slot {
+        ChunkCoord chunkID{0, 0};
+        uint64_t lastUsed = 0;
+        optional<Chunk> chunk;
+    };
+
+    void resize(size_t capacity) {
+        slots.clear();
+        slots.resize(capacity);
+        cachedCount = 0;
+
+        // The ring is kept at most half full so that probe sequences stay short
+        size_t ringSize = 1;
+        while (ringSize < 2 * capacity) {
+            ringSize *= 2;
+        }
+        ring.assign(ringSize, NO_SLOT);
+        ringMask = ringSize - 1;
+    }
+
+    [[nodiscard]] size_t ringPosition(ChunkCoord chunkID) const {
+        return static_cast<size_t>(chunkCoordHash(chunkID)) & ringMask;
+    }
+
+    [[nodiscard]] int32_t findSlot(ChunkCoord chunkID) const {
+        for (size_t i = ringPosition(chunkID);; i = (i + 1) & ringMask) {
+            int32_t slot = ring[i];
+            if (slot == NO_SLOT || slots[slot].chunkID == chunkID) {
+                return slot;
+            }
+        }
+    }
+
+    void addToRing(int32_t slot) {
+        size_t i = ringPosition(slots[slot].chunkID);
+        while (ring[i] != NO_SLOT) {
+            i = (i + 1) & ringMask;
+        }
+        ring[i] = slot;
+    }
+
+    // Linear probing removal: later entries of the same probe sequence are shifted back into the hole
+    void removeFromRing(int32_t slot) {
+        size_t hole = ringPosition(slots[slot].chunkID);
+        while (ring[hole] != slot) {
+            hole = (hole + 1) & ringMask;
+        }
+
+        for (size_t i = (hole + 1) & ringMask; ring[i] != NO_SLOT; i = (i + 1) & ringMask) {
+            size_t home = ringPosition(slots[ring[i]].chunkID);
+            // The entry can move into the hole if its home position is not between the hole and its position
+            bool canMove = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+            if (canMove) {
+                ring[hole] = ring[i];
+                hole = i;
+            }
+        }
+        ring[hole] = NO_SLOT;
+    }
+
+    [[nodiscard]] int32_t leastRecentlyUsedSlot() const {
+        int32_t oldest = 0;
+        for (int32_t i = 1; i < static_cast<int32_t>(cachedCount); i++) {
+            if (slots[i].lastUsed < slots[oldest].lastUsed) {
+                oldest = i;
+            }
+        }
+        return oldest;
+    }
+
+    vector<Slot> slots;       // Cached chunks, the first cachedCount slots are in use
+    size_t cachedCount = 0;
+    vector<int32_t> ring;     // Slot of each chunk, open addressing with linear probing
+    size_t ringMask = 0;
+    uint64_t useCounter = 0;
+    size_t evictionCount = 0;
+};
+
+#endif //PROCEDURALWORLD_CHUNK_CACHE_H
@@ -0,0 +1,56 @@
+#ifndef PROCEDURALWORLD_CHUNK_COORD_H
+#define PROCEDURALWORLD_CHUNK_COORD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+// Position of a chunk in the world grid. A chunk covers 100x100 units, x counts columns (the road runs along the
+// column x = 0) and z counts chunks along the road.
+struct ChunkCoord {
+    int x;
+    int z;
+
+    bool operator==(const ChunkCoord &other) const { return x == other.x && z == other.z; }
+
+    bool operator!=(const ChunkCoord &other) const { return !(*this == other); }
+
+    bool operator<(const ChunkCoord &other) const { return x != other.x ? x < other.x : z < other.z; }
+};
+
+// Chunks next to each other along z get consecutive hashes, the column is spread with an odd multiplier so every
+// column of a small window lands somewhere else
+inline uint32_t chunkCoordHash(ChunkCoord coord) {
+    return static_cast<uint32_t>(coord.z) + static_cast<uint32_t>(coord.x) * 0x9E3779B1u;
+}
+
+// Number of chunk steps between two chunks when moving diagonally counts as one step
+inline int chunkRingDistance(ChunkCoord a, ChunkCoord b) {
+    return std::max(std::abs(a.x - b.x), std::abs(a.z - b.z));
+}
+
+// Offsets of every chunk within radius rings of the center, ordered ring by ring from the center outwards and by
+// distance inside a ring. Streaming in this order loads the chunks closest to the camera first.
+inline vector<ChunkCoord> chunkSpiral(int radius) {
+    vector<ChunkCoord> offsets;
+    for (int x = -radius; x <= radius; x++) {
+        for (int z = -radius; z <= radius; z++) {
+            offsets.push_back(ChunkCoord{x, z});
+        }
+    }
+
+    stable_sort(offsets.begin(), offsets.end(), [](ChunkCoord a, ChunkCoord b) {
+        int ringA = chunkRingDistance(a, ChunkCoord{0, 0});
+        int ringB = chunkRingDistance(b, ChunkCoord{0, 0});
+        if (ringA != ringB) {
+            return ringA < ringB;
+        }
+        return a.x * a.x + a.z * a.z < b.x * b.x + b.z * b.z;
+    });
+    return offsets;
+}
+
+#endif //PROCEDURALWORLD_CHUNK_COORD_H
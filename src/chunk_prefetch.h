@@ -0,0 +1,67 @@
+#ifndef PROCEDURALWORLD_CHUNK_PREFETCH_H
+#define PROCEDURALWORLD_CHUNK_PREFETCH_H
+
+#include "chunk_coord.h"
+#include "world.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+// A chunk that should be generated, with the estimated time in seconds until the camera needs it
+struct ChunkNeed {
+    ChunkCoord chunkID;
+    float timeToArrival;
+};
+
+const float PREFETCH_LOOKAHEAD_SECONDS = 4.0f; // How far ahead the camera's path is followed
+const float PREFETCH_MIN_SPEED = 1.0f;         // Below this speed (units per second) nothing is prefetched
+
+// Chunks the camera needs now and the ones it will need next if it keeps its velocity, ordered by time to arrival.
+// The visible chunks come first (time 0, nearest first, in the order of viewOffsets), then the chunks that come into
+// view along the predicted path, each with the time at which it first does.
+inline vector<ChunkNeed> predictChunkNeeds(vec3 position, vec3 velocity, const vector<ChunkCoord> &viewOffsets,
+                                           float lookaheadSeconds = PREFETCH_LOOKAHEAD_SECONDS) {
+    vector<ChunkNeed> needs;
+    map<ChunkCoord, size_t> needIndex;
+
+    auto need = [&](ChunkCoord center, float time) {
+        for (const auto &offset: viewOffsets) {
+            ChunkCoord chunkID{center.x + offset.x, center.z + offset.z};
+            auto found = needIndex.emplace(chunkID, needs.size());
+            if (found.second) {
+                needs.push_back(ChunkNeed{chunkID, time});
+            } else {
+                needs[found.first->second].timeToArrival = std::min(needs[found.first->second].timeToArrival, time);
+            }
+        }
+    };
+
+    ChunkCoord current = WorldChunk::coordAt(position.x, position.z);
+    need(current, 0.0f);
+
+    // The path is sampled every half chunk, so no chunk the camera crosses is skipped
+    float speed = length(vec2(velocity.x, velocity.z));
+    if (speed >= PREFETCH_MIN_SPEED) {
+        float step = 50.0f / speed;
+        ChunkCoord last = current;
+        for (float time = step; time <= lookaheadSeconds; time += step) {
+            ChunkCoord ahead = WorldChunk::coordAt(position.x + velocity.x * time, position.z + velocity.z * time);
+            if (ahead != last) {
+                need(ahead, time);
+                last = ahead;
+            }
+        }
+    }
+
+    stable_sort(needs.begin(), needs.end(), [](const ChunkNeed &a, const ChunkNeed &b) {
+        return a.timeToArrival < b.timeToArrival;
+    });
+    return needs;
+}
+
+#endif //PROCEDURALWORLD_CHUNK_PREFETCH_H
@@ -0,0 +1,284 @@
+#ifndef PROCEDURALWORLD_CHUNK_STORE_H
+#define PROCEDURALWORLD_CHUNK_STORE_H
+
+#include "chunk_coord.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Binary chunk files.
+// A file is a header, a table of sections and the sections themselves. Every section is a plain array of fixed size
+// records aligned to 16 bytes, so once a file is mapped in memory its sections are read in place, nothing is parsed.
+
+const char CHUNK_FILE_MAGIC[4] = {'P', 'W', 'C', 'K'};
+const size_t CHUNK_FILE_ALIGNMENT = 16;
+
+struct ChunkFileHeader {
+    char magic[4];
+    uint32_t formatVersion;
+    uint64_t worldSeed;
+    int32_t chunkX;
+    int32_t chunkZ;
+    uint32_t sectionCount;
+};
+
+struct ChunkFileSection {
+    uint32_t type;
+    uint32_t elementSize;
+    uint64_t count;
+    uint64_t offset; // From the start of the file
+};
+
+// Collects the sections of a chunk and writes them as a chunk file
+class ChunkFileWriter {
+public:
+    template<class T>
+    void addSection(uint32_t type, const T *elements, size_t count) {
+        static_assert(is_trivially_copyable<T>::value, "Sections only hold plain records");
+
+        sections.push_back(ChunkFileSection{type, static_cast<uint32_t>(sizeof(T)), count, data.size()});
+        const auto *bytes = reinterpret_cast<const char *>(elements);
+        data.insert(data.end(), bytes, bytes + count * sizeof(T));
+        data.resize((data.size() + CHUNK_FILE_ALIGNMENT - 1) / CHUNK_FILE_ALIGNMENT * CHUNK_FILE_ALIGNMENT);
+    }
+
+    template<class T>
+    void addSection(uint32_t type, const vector<T> &elements) {
+        addSection(type, elements.data(), elements.size());
+    }
+
+    // The file is written next to its final path and renamed, so a reader never maps a half written file
+    bool writeTo(const string &path, const ChunkFileHeader &header) const {
+        size_t tableSize = sizeof(ChunkFileHeader) + sections.size() * sizeof(ChunkFileSection);
+        size_t dataStart = (tableSize + CHUNK_FILE_ALIGNMENT - 1) / CHUNK_FILE_ALIGNMENT * CHUNK_FILE_ALIGNMENT;
+
+        ChunkFileHeader fileHeader = header;
+        fileHeader.sectionCount = static_cast<uint32_t>(sections.size());
+        vector<ChunkFileSection> table = sections;
+        for (auto &section: table) {
+            section.offset += dataStart;
+        }
+
+        string temporaryPath = path + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        const char padding[CHUNK_FILE_ALIGNMENT] = {};
+        bool written = fwrite(&fileHeader, sizeof(fileHeader), 1, file) == 1 &&
+                       fwrite(table.data(), sizeof(ChunkFileSection), table.size(), file) == table.size() &&
+                       fwrite(padding, 1, dataStart - tableSize, file) == dataStart - tableSize &&
+                       fwrite(data.data(), 1, data.size(), file) == data.size();
+        written = fclose(file) == 0 && written;
+
+        std::error_code error;
+        if (written) {
+            filesystem::rename(temporaryPath, path, error);
+        }
+        if (!written || error) {
+            filesystem::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    vector<ChunkFileSection> sections; // Offsets are relative to the start of data until the file is written
+    vector<char> data;
+};
+
+// A chunk file mapped read-only in memory, it stays mapped until the object is destroyed
+class MappedChunkFile {
+public:
+    MappedChunkFile() = default;
+
+    ~MappedChunkFile() {
+        close();
+    }
+
+    MappedChunkFile(MappedChunkFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedChunkFile &operator=(MappedChunkFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            swap(bytes, other.bytes);
+            swap(size, other.size);
+#if defined(_WIN32)
+            swap(mapping, other.mapping);
+#endif
+        }
+        return *this;
+    }
+
+    // Maps the file and checks that its section table fits in it
+    bool open(const string &path) {
+        close();
+
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                bytes = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                size = static_cast<size_t>(fileSize.QuadPart);
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+        struct stat fileStatus{};
+        if (fstat(file, &fileStatus) == 0 && fileStatus.st_size > 0) {
+            void *mapped = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = static_cast<const char *>(mapped);
+                size = static_cast<size_t>(fileStatus.st_size);
+            }
+        }
+        ::close(file);
+#endif
+
+        if (bytes == nullptr || !hasValidLayout()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] const ChunkFileHeader &header() const {
+        return *reinterpret_cast<const ChunkFileHeader *>(bytes);
+    }
+
+    // Elements of a section, points into the mapped file. Empty if the section is missing or holds another record type.
+    template<class T>
+    [[nodiscard]] pair<const T *, size_t> section(uint32_t type) const {
+        const auto *table = reinterpret_cast<const ChunkFileSection *>(bytes + sizeof(ChunkFileHeader));
+        for (uint32_t i = 0; i < header().sectionCount; i++) {
+            if (table[i].type == type && table[i].elementSize == sizeof(T)) {
+                return {reinterpret_cast<const T *>(bytes + table[i].offset), static_cast<size_t>(table[i].count)};
+            }
+        }
+        return {nullptr, 0};
+    }
+
+    template<class T>
+    [[nodiscard]] vector<T> sectionVector(uint32_t type) const {
+        auto elements = section<T>(type);
+        return vector<T>(elements.first, elements.first + elements.second);
+    }
+
+private:
+    [[nodiscard]] bool hasValidLayout() const {
+        if (size < sizeof(ChunkFileHeader) || memcmp(header().magic, CHUNK_FILE_MAGIC, sizeof(CHUNK_FILE_MAGIC)) != 0) {
+            return false;
+        }
+        uint64_t tableEnd = sizeof(ChunkFileHeader) + uint64_t(header().sectionCount) * sizeof(ChunkFileSection);
+        if (tableEnd > size) {
+            return false;
+        }
+        const auto *table = reinterpret_cast<const ChunkFileSection *>(bytes + sizeof(ChunkFileHeader));
+        for (uint32_t i = 0; i < header().sectionCount; i++) {
+            const ChunkFileSection &section = table[i];
+            if (section.offset % CHUNK_FILE_ALIGNMENT != 0 || section.offset > size ||
+                section.elementSize == 0 || section.count > (size - section.offset) / section.elementSize) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        if (bytes != nullptr) {
+#if defined(_WIN32)
+            UnmapViewOfFile(bytes);
+#else
+            munmap(const_cast<char *>(bytes), size);
+#endif
+        }
+#if defined(_WIN32)
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        mapping = nullptr;
+#endif
+        bytes = nullptr;
+        size = 0;
+    }
+
+    const char *bytes = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// Directory of chunk files, one file per chunk of a world seed. Files written for another seed or another format
+// version are ignored, the chunk is then generated again and its file replaced.
+class ChunkStore {
+public:
+    ChunkStore(string directory, uint32_t formatVersion)
+            : directory(std::move(directory)), formatVersion(formatVersion) {
+        std::error_code error;
+        filesystem::create_directories(this->directory, error);
+    }
+
+    bool load(uint64_t worldSeed, ChunkCoord chunkID, MappedChunkFile &file) const {
+        if (!file.open(path(worldSeed, chunkID))) {
+            return false;
+        }
+        const ChunkFileHeader &header = file.header();
+        return header.formatVersion == formatVersion && header.worldSeed == worldSeed &&
+               header.chunkX == chunkID.x && header.chunkZ == chunkID.z;
+    }
+
+    bool save(uint64_t worldSeed, ChunkCoord chunkID, const ChunkFileWriter &writer) const {
+        ChunkFileHeader header{};
+        memcpy(header.magic, CHUNK_FILE_MAGIC, sizeof(CHUNK_FILE_MAGIC));
+        header.formatVersion = formatVersion;
+        header.worldSeed = worldSeed;
+        header.chunkX = chunkID.x;
+        header.chunkZ = chunkID.z;
+        return writer.writeTo(path(worldSeed, chunkID), header);
+    }
+
+private:
+    [[nodiscard]] string path(uint64_t worldSeed, ChunkCoord chunkID) const {
+        return directory + "/chunk_" + to_string(worldSeed) + "_" + to_string(chunkID.x) + "_" + to_string(chunkID.z) +
+               ".bin";
+    }
+
+    string directory;
+    uint32_t formatVersion;
+};
+
+#endif //PROCEDURALWORLD_CHUNK_STORE_H
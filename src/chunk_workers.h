@@ -0,0 +1,215 @@
+#ifndef PROCEDURALWORLD_CHUNK_WORKERS_H
+#define PROCEDURALWORLD_CHUNK_WORKERS_H
+
+#include "chunk_coord.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Generates world chunks on a pool of background threads so that the render loop never has to wait for them.
+// Chunks are queued with request() and every finished chunk is handed back to the render thread through a second
+// queue, which is drained once per frame with collectFinished(). Chunks are made by the buildChunk function.
+//
+// Queued chunks are generated by priority, the lowest value first (the time until the chunk is needed). With no
+// threads at all the queue is only worked on by pump(), which the render loop calls with a per-frame time budget.
+template<class Chunk>
+class ChunkWorkerPool {
+public:
+    explicit ChunkWorkerPool(function<Chunk(ChunkCoord)> buildChunk, unsigned int threadCount = defaultThreadCount())
+            : buildChunk(std::move(buildChunk)) {
+        startWorkers(threadCount);
+    }
+
+    ~ChunkWorkerPool() {
+        stopWorkers();
+    }
+
+    ChunkWorkerPool(const ChunkWorkerPool &) = delete;
+    ChunkWorkerPool &operator=(const ChunkWorkerPool &) = delete;
+
+    // Replaces the worker threads, queued requests are kept. Zero threads means the chunks are only built by pump().
+    void setThreadCount(unsigned int threadCount) {
+        stopWorkers();
+        startWorkers(threadCount);
+    }
+
+    // Drops the queued requests and joins the worker threads, the chunks they already started are finished and can
+    // still be collected. Has to run before anything buildChunk uses is destroyed.
+    void stop() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            for (const auto &queued: requested) {
+                pending.erase(queued.first);
+            }
+            requested.clear();
+        }
+        stopWorkers();
+    }
+
+    [[nodiscard]] unsigned int getThreadCount() const {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    // Queues the chunk for generation, unless it is being generated or waiting to be collected. A chunk that is
+    // already queued keeps the lowest of its priorities.
+    void request(ChunkCoord chunkID, float priority = 0.0f) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            if (!pending.insert(chunkID).second) {
+                for (auto &queued: requested) {
+                    if (queued.first == chunkID) {
+                        queued.second = std::min(queued.second, priority);
+                        break;
+                    }
+                }
+                return;
+            }
+            requested.emplace_back(chunkID, priority);
+        }
+        queueCondition.notify_one();
+    }
+
+    [[nodiscard]] bool isPending(ChunkCoord chunkID) const {
+        lock_guard<mutex> lock(queueMutex);
+        return pending.count(chunkID) != 0;
+    }
+
+    // Returns at most maxCount chunks finished since the last call, oldest first. Never waits for chunks that are still
+    // being generated, the others stay queued for the next call.
+    vector<pair<ChunkCoord, Chunk>> collectFinished(size_t maxCount = SIZE_MAX) {
+        vector<pair<ChunkCoord, Chunk>> collected;
+
+        lock_guard<mutex> lock(queueMutex);
+        collected.reserve(std::min(maxCount, finished.size()));
+        while (!finished.empty() && collected.size() < maxCount) {
+            pending.erase(finished.front().first);
+            collected.push_back(std::move(finished.front()));
+            finished.pop_front();
+        }
+
+        return collected;
+    }
+
+    // Drops the queued requests that are no longer wanted, chunks that a worker already started are still finished
+    template<class Predicate>
+    void cancelRequestsIf(Predicate isUnwanted) {
+        lock_guard<mutex> lock(queueMutex);
+        auto kept = remove_if(requested.begin(), requested.end(), [&](const pair<ChunkCoord, float> &queued) {
+            if (!isUnwanted(queued.first)) {
+                return false;
+            }
+            pending.erase(queued.first);
+            return true;
+        });
+        requested.erase(kept, requested.end());
+    }
+
+    // Builds queued chunks on the calling thread until the budget is used up, only when the pool has no threads.
+    // A chunk that is started is always finished, so a call can overrun the budget by one chunk.
+    size_t pump(double budgetSeconds) {
+        if (!workers.empty()) {
+            return 0;
+        }
+
+        auto start = chrono::steady_clock::now();
+        size_t built = 0;
+        while (chrono::duration<double>(chrono::steady_clock::now() - start).count() < budgetSeconds) {
+            ChunkCoord chunkID;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if (requested.empty()) {
+                    break;
+                }
+                chunkID = takeNextRequest();
+            }
+
+            Chunk chunk = buildChunk(chunkID);
+
+            lock_guard<mutex> lock(queueMutex);
+            finished.emplace_back(chunkID, std::move(chunk));
+            built++;
+        }
+        return built;
+    }
+
+    // One thread is left for the render loop
+    static unsigned int defaultThreadCount() {
+        unsigned int hardwareThreads = thread::hardware_concurrency();
+        return std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+    }
+
+private:
+    void startWorkers(unsigned int threadCount) {
+        stopping = false;
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.emplace_back(&ChunkWorkerPool::workerLoop, this);
+        }
+    }
+
+    void stopWorkers() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+
+        for (auto &worker: workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    // Removes the queued request with the lowest priority, the queue lock has to be held and the queue not empty
+    ChunkCoord takeNextRequest() {
+        auto next = min_element(requested.begin(), requested.end(),
+                                [](const pair<ChunkCoord, float> &a, const pair<ChunkCoord, float> &b) {
+                                    return a.second < b.second;
+                                });
+        ChunkCoord chunkID = next->first;
+        requested.erase(next);
+        return chunkID;
+    }
+
+    void workerLoop() {
+        while (true) {
+            ChunkCoord chunkID;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !requested.empty(); });
+                if (stopping) {
+                    return;
+                }
+                chunkID = takeNextRequest();
+            }
+
+            // The expensive part runs without holding the lock
+            Chunk chunk = buildChunk(chunkID);
+
+            lock_guard<mutex> lock(queueMutex);
+            finished.emplace_back(chunkID, std::move(chunk));
+        }
+    }
+
+    function<Chunk(ChunkCoord)> buildChunk;
+    vector<thread> workers;
+
+    mutable mutex queueMutex;
+    condition_variable queueCondition;
+    vector<pair<ChunkCoord, float>> requested; // Chunks waiting for a worker, with their priority
+    deque<pair<ChunkCoord, Chunk>> finished;   // Generated chunks waiting for the render thread
+    set<ChunkCoord> pending;                   // Every chunk that is requested but not collected yet
+    bool stopping = false;
+};
+
+#endif //PROCEDURALWORLD_CHUNK_WORKERS_H
@@ -0,0 +1,95 @@
+#ifndef PROCEDURALWORLD_FRUSTUM_H
+#define PROCEDURALWORLD_FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+using namespace glm;
+using namespace std;
+
+// The six planes of a view frustum, for culling chunks and parts before they are drawn. The planes point inwards, a
+// point p is inside when dot(plane.xyz, p) + plane.w >= 0 for every plane.
+class Frustum {
+public:
+    enum Containment {
+        OUTSIDE, INTERSECTS, INSIDE
+    };
+
+    // Everything is inside the default frustum, passes that must not cull use it
+    Frustum() {
+        for (auto &plane: planes) {
+            plane = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    // Planes of viewProjection (Gribb and Hartmann), usually projectionMatrix * viewMatrix
+    explicit Frustum(const mat4 &viewProjection) {
+        vec4 rows[4];
+        for (int row = 0; row < 4; row++) {
+            rows[row] = vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row],
+                             viewProjection[3][row]);
+        }
+        planes[0] = rows[3] + rows[0]; // Left
+        planes[1] = rows[3] - rows[0]; // Right
+        planes[2] = rows[3] + rows[1]; // Bottom
+        planes[3] = rows[3] - rows[1]; // Top
+        planes[4] = rows[3] + rows[2]; // Near
+        planes[5] = rows[3] - rows[2]; // Far
+        for (auto &plane: planes) {
+            plane = plane / length(vec3(plane));
+        }
+    }
+
+    [[nodiscard]] Containment classifyBox(vec3 boxMin, vec3 boxMax) const {
+        Containment containment = INSIDE;
+        for (const auto &plane: planes) {
+            // The corners farthest along and against the plane's normal
+            vec3 farthest(plane.x > 0.0f ? boxMax.x : boxMin.x, plane.y > 0.0f ? boxMax.y : boxMin.y,
+                          plane.z > 0.0f ? boxMax.z : boxMin.z);
+            vec3 nearest(plane.x > 0.0f ? boxMin.x : boxMax.x, plane.y > 0.0f ? boxMin.y : boxMax.y,
+                         plane.z > 0.0f ? boxMin.z : boxMax.z);
+            if (dot(vec3(plane), farthest) + plane.w < 0.0f) {
+                return OUTSIDE;
+            }
+            if (dot(vec3(plane), nearest) + plane.w < 0.0f) {
+                containment = INTERSECTS;
+            }
+        }
+        return containment;
+    }
+
+    // Sets visible[i] to 1 for the spheres that are at least partly inside and to 0 for the others. One plane at a
+    // time over all spheres in plain loops over arrays, which the compiler turns into SIMD code.
+    void cullSpheres(const float *x, const float *y, const float *z, const float *radius, size_t count,
+                     uint8_t *visible) const {
+        for (size_t i = 0; i < count; i++) {
+            visible[i] = 1;
+        }
+        for (const auto &plane: planes) {
+            for (size_t i = 0; i < count; i++) {
+                float distance = plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w;
+                visible[i] &= static_cast<uint8_t>(distance >= -radius[i]);
+            }
+        }
+    }
+
+private:
+    vec4 planes[6];
+};
+
+// Clears visible[i] for the spheres whose diameter divided by their distance from eye is below minSize. With minSize
+// the size of a pixel one unit in front of eye, these are the spheres that cover less than a pixel.
+inline void cullSmallSpheres(const float *x, const float *y, const float *z, const float *radius, size_t count,
+                             vec3 eye, float minSize, uint8_t *visible) {
+    // (2 * radius / distance)^2 >= minSize^2, without a square root or a division
+    float scale = 4.0f / (minSize * minSize);
+    for (size_t i = 0; i < count; i++) {
+        float dx = x[i] - eye.x;
+        float dy = y[i] - eye.y;
+        float dz = z[i] - eye.z;
+        visible[i] &= static_cast<uint8_t>(radius[i] * radius[i] * scale >= dx * dx + dy * dy + dz * dz);
+    }
+}
+
+#endif //PROCEDURALWORLD_FRUSTUM_H
@@ -0,0 +1,161 @@
+#ifndef PROCEDURALWORLD_GL_STATE_H
+#define PROCEDURALWORLD_GL_STATE_H
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC 1
+#endif
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+// Thin cache over the GL binding calls of the render loop. Every call is compared with the last value set through the
+// cache and only reaches the driver when it changes something. The calls it saves are counted, see printStats().
+// All changes of the tracked state have to go through glState, a direct GL call makes the cache wrong until
+// invalidate().
+class GLStateCache {
+public:
+    static constexpr int TEXTURE_UNIT_COUNT = 16;
+
+    GLStateCache() {
+        invalidate();
+    }
+
+    // Forgets everything, the next call of every kind reaches the driver
+    void invalidate() {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        framebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (auto &unit: textures) {
+            for (auto &texture: unit) {
+                texture = UNKNOWN;
+            }
+        }
+        viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+        depthFunc = UNKNOWN;
+    }
+
+    void useProgram(GLuint id) {
+        if (changed(program, id)) {
+            glUseProgram(id);
+        }
+    }
+
+    void bindVertexArray(GLuint id) {
+        if (changed(vertexArray, id)) {
+            glBindVertexArray(id);
+        }
+    }
+
+    // Deleting the bound vertex array binds 0 instead, like GL does
+    void deleteVertexArray(GLuint id) {
+        glDeleteVertexArrays(1, &id);
+        if (vertexArray == id) {
+            vertexArray = 0;
+        }
+    }
+
+    void activeTexture(GLenum unit) {
+        if (changed(activeUnit, unit)) {
+            glActiveTexture(unit);
+        }
+    }
+
+    // Binds to the active unit, like glBindTexture. Targets other than 2D, 2D array and cube map are not cached.
+    void bindTexture(GLenum target, GLuint id) {
+        int slot = targetSlot(target);
+        GLuint unit = activeUnit == UNKNOWN ? UNKNOWN : activeUnit - GL_TEXTURE0;
+        if (slot < 0 || unit >= TEXTURE_UNIT_COUNT) {
+            glBindTexture(target, id);
+            issuedCount++;
+            return;
+        }
+        if (changed(textures[unit][slot], id)) {
+            glBindTexture(target, id);
+        }
+    }
+
+    void bindFramebuffer(GLuint id) {
+        if (changed(framebuffer, id)) {
+            glBindFramebuffer(GL_FRAMEBUFFER, id);
+        }
+    }
+
+    void setViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+        if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+            skippedCount++;
+            return;
+        }
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = width;
+        viewport[3] = height;
+        glViewport(x, y, width, height);
+        issuedCount++;
+    }
+
+    void setDepthFunc(GLenum func) {
+        if (changed(depthFunc, func)) {
+            glDepthFunc(func);
+        }
+    }
+
+    [[nodiscard]] GLuint getProgram() const { return program; }
+
+    [[nodiscard]] uint64_t getIssuedCount() const { return issuedCount; }
+
+    [[nodiscard]] uint64_t getSkippedCount() const { return skippedCount; }
+
+    void printStats() const {
+        uint64_t total = issuedCount + skippedCount;
+        cout << "GL state changes: " << issuedCount << " issued, " << skippedCount << " skipped ("
+             << (total > 0 ? 100.0 * static_cast<double>(skippedCount) / static_cast<double>(total) : 0.0)
+             << "% redundant)\n";
+    }
+
+private:
+    static constexpr GLuint UNKNOWN = ~0u;
+
+    static int targetSlot(GLenum target) {
+        switch (target) {
+            case GL_TEXTURE_2D:
+                return 0;
+            case GL_TEXTURE_2D_ARRAY:
+                return 1;
+            case GL_TEXTURE_CUBE_MAP:
+                return 2;
+            default:
+                return -1;
+        }
+    }
+
+    // Counts the call, true if it has to reach the driver
+    bool changed(GLuint &current, GLuint value) {
+        if (current == value) {
+            skippedCount++;
+            return false;
+        }
+        current = value;
+        issuedCount++;
+        return true;
+    }
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint framebuffer;
+    GLuint activeUnit;
+    GLuint textures[TEXTURE_UNIT_COUNT][3]; // Per unit: 2D, 2D array, cube map
+    GLint viewport[4];
+    GLenum depthFunc;
+
+    uint64_t issuedCount = 0;
+    uint64_t skippedCount = 0;
+};
+
+// The render thread's GL state, the only thread with a GL context
+inline GLStateCache glState;
+
+#endif //PROCEDURALWORLD_GL_STATE_H
@@ -0,0 +1,191 @@
+#ifndef PROCEDURALWORLD_IMPOSTORS_H
+#define PROCEDURALWORLD_IMPOSTORS_H
+
+#include "prop_parts.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+// Octahedral impostors: a prop shape is rendered once from IMPOSTOR_GRID x IMPOSTOR_GRID directions of the upper
+// hemisphere into one atlas, and far away the prop is drawn as a single camera-facing quad showing the atlas cell
+// whose direction is closest to the camera's. The directions are spread with the hemi-octahedral mapping, which maps
+// the upper hemisphere onto a square without wasting any cell.
+//
+// Atlases are ray cast on the CPU from the shape's boxes, so the workers bake them while they generate chunks, and
+// only hold what the shading needs: every texel is the part's material layer, whether its color tints the material,
+// and coverage, all multiplied by coverage so that mipmaps stay correct at the silhouette (divide by alpha to read).
+
+const int IMPOSTOR_GRID = 8;
+const int IMPOSTOR_CELL_SIZE = 64;
+const int IMPOSTOR_ATLAS_SIZE = IMPOSTOR_GRID * IMPOSTOR_CELL_SIZE;
+
+// Direction in the upper hemisphere to [0, 1]^2, directions below the horizon are clamped onto it
+inline vec2 hemiOctahedralEncode(vec3 direction) {
+    direction.y = std::max(direction.y, 0.0f);
+    vec3 d = direction / (std::abs(direction.x) + direction.y + std::abs(direction.z) + 1e-6f);
+    return vec2((d.x + d.z) * 0.5f + 0.5f, (d.x - d.z) * 0.5f + 0.5f);
+}
+
+inline vec3 hemiOctahedralDecode(vec2 coord) {
+    float u = coord.x * 2.0f - 1.0f;
+    float v = coord.y * 2.0f - 1.0f;
+    float x = (u + v) * 0.5f;
+    float z = (u - v) * 0.5f;
+    return normalize(vec3(x, 1.0f - std::abs(x) - std::abs(z), z));
+}
+
+// Axes of the view looking at a prop from direction, the same as IMPOSTOR_VERT's
+inline void impostorViewAxes(vec3 direction, vec3 &right, vec3 &up) {
+    vec3 side = cross(vec3(0.0f, 1.0f, 0.0f), direction);
+    right = dot(side, side) > 1e-6f ? normalize(side) : vec3(1.0f, 0.0f, 0.0f);
+    up = cross(direction, right);
+}
+
+// Grows the bounds by a unit cube transformed by model
+inline void growBoxBounds(const mat4 &model, vec3 &boundsMin, vec3 &boundsMax) {
+    for (int corner = 0; corner < 8; corner++) {
+        vec3 local((corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 0.5f : -0.5f, (corner & 4) ? 0.5f : -0.5f);
+        vec3 position(model * vec4(local, 1.0f));
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
+}
+
+// A prop's boxes relative to its base at the origin, with the sphere the impostor quad covers
+struct ImpostorShape {
+    vector<PartInstance> boxes;
+    vec3 center = vec3(0.0f);
+    float radius = 0.0f;
+    float height = 0.0f; // Top of the highest box
+    float width = 0.0f;  // Widest box across x and z
+
+    explicit ImpostorShape(vector<PartInstance> parts) : boxes(std::move(parts)) {
+        vec3 boundsMin(INFINITY);
+        vec3 boundsMax(-INFINITY);
+        for (const auto &box: boxes) {
+            growBoxBounds(box.model, boundsMin, boundsMax);
+        }
+        center = (boundsMin + boundsMax) * 0.5f;
+        radius = length(boundsMax - center);
+        height = boundsMax.y;
+        width = std::max(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z);
+    }
+};
+
+// One impostor in the world, the shape scaled by radius / shape's radius
+struct TreeImpostor {
+    vec3 center;
+    float radius;
+    vec3 color;         // Tints the parts whose material is tinted
+    uint32_t archetype; // Layer of the impostor atlas array
+    uint32_t prop;      // Prop the impostor stands in for, numbered like PartInstance::prop
+};
+
+// Ray casts the shape into an IMPOSTOR_ATLAS_SIZE square RGBA atlas
+inline vector<uint8_t> bakeImpostorAtlas(const ImpostorShape &shape) {
+    vector<uint8_t> texels(static_cast<size_t>(IMPOSTOR_ATLAS_SIZE) * IMPOSTOR_ATLAS_SIZE * 4, 0);
+    vector<mat4> toLocal;
+    toLocal.reserve(shape.boxes.size());
+    for (const auto &box: shape.boxes) {
+        toLocal.push_back(inverse(box.model));
+    }
+
+    for (int cellY = 0; cellY < IMPOSTOR_GRID; cellY++) {
+        for (int cellX = 0; cellX < IMPOSTOR_GRID; cellX++) {
+            vec3 direction = hemiOctahedralDecode(vec2((cellX + 0.5f) / IMPOSTOR_GRID, (cellY + 0.5f) / IMPOSTOR_GRID));
+            vec3 right, up;
+            impostorViewAxes(direction, right, up);
+
+            for (int y = 0; y < IMPOSTOR_CELL_SIZE; y++) {
+                for (int x = 0; x < IMPOSTOR_CELL_SIZE; x++) {
+                    // Orthographic rays toward the shape, the cell covers its sphere
+                    float u = ((x + 0.5f) / IMPOSTOR_CELL_SIZE) * 2.0f - 1.0f;
+                    float v = ((y + 0.5f) / IMPOSTOR_CELL_SIZE) * 2.0f - 1.0f;
+                    vec3 origin = shape.center + (u * right + v * up + 2.0f * direction) * shape.radius;
+
+                    float nearest = INFINITY;
+                    const PartInstance *hit = nullptr;
+                    for (size_t b = 0; b < shape.boxes.size(); b++) {
+                        // Slab test against the unit cube in the box's own space
+                        vec3 localOrigin(toLocal[b] * vec4(origin, 1.0f));
+                        vec3 localDirection(toLocal[b] * vec4(-direction, 0.0f));
+                        float enter = 0.0f;
+                        float exit = INFINITY;
+                        for (int axis = 0; axis < 3; axis++) {
+                            if (std::abs(localDirection[axis]) < 1e-9f) {
+                                if (std::abs(localOrigin[axis]) > 0.5f) {
+                                    exit = -1.0f;
+                                }
+                                continue;
+                            }
+                            float t0 = (-0.5f - localOrigin[axis]) / localDirection[axis];
+                            float t1 = (0.5f - localOrigin[axis]) / localDirection[axis];
+                            enter = std::max(enter, std::min(t0, t1));
+                            exit = std::min(exit, std::max(t0, t1));
+                        }
+                        if (enter <= exit && enter < nearest) {
+                            nearest = enter;
+                            hit = &shape.boxes[b];
+                        }
+                    }
+                    if (hit == nullptr) {
+                        continue;
+                    }
+
+                    size_t texel = (static_cast<size_t>(cellY * IMPOSTOR_CELL_SIZE + y) * IMPOSTOR_ATLAS_SIZE +
+                                    cellX * IMPOSTOR_CELL_SIZE + x) * 4;
+                    texels[texel] = static_cast<uint8_t>(hit->layer);
+                    texels[texel + 1] = hit->tint > 0.5f ? 255 : 0;
+                    texels[texel + 3] = 255;
+                }
+            }
+        }
+    }
+    return texels;
+}
+
+// The impostor shapes of a set of archetypes, each baked the first time a chunk needs it. Any thread can bake, the
+// render thread uploads every atlas once isBaked() says it is done.
+class ImpostorLibrary {
+public:
+    explicit ImpostorLibrary(vector<ImpostorShape> archetypes)
+            : shapes(std::move(archetypes)), atlases(shapes.size()), bakeOnce(shapes.size()), baked(shapes.size()) {}
+
+    ImpostorLibrary(const ImpostorLibrary &) = delete;
+    ImpostorLibrary &operator=(const ImpostorLibrary &) = delete;
+
+    [[nodiscard]] uint32_t count() const { return static_cast<uint32_t>(shapes.size()); }
+
+    [[nodiscard]] const ImpostorShape &shape(uint32_t archetype) const { return shapes[archetype]; }
+
+    void bake(uint32_t archetype) {
+        call_once(bakeOnce[archetype], [&]() {
+            atlases[archetype] = bakeImpostorAtlas(shapes[archetype]);
+            baked[archetype].store(true, memory_order_release);
+        });
+    }
+
+    [[nodiscard]] bool isBaked(uint32_t archetype) const {
+        return baked[archetype].load(memory_order_acquire);
+    }
+
+    // Only once isBaked(archetype)
+    [[nodiscard]] const vector<uint8_t> &atlas(uint32_t archetype) const { return atlases[archetype]; }
+
+private:
+    vector<ImpostorShape> shapes;
+    vector<vector<uint8_t>> atlases;
+    vector<once_flag> bakeOnce;
+    vector<atomic<bool>> baked;
+};
+
+#endif //PROCEDURALWORLD_IMPOSTORS_H
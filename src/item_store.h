@@ -0,0 +1,71 @@
+#ifndef PROCEDURALWORLD_ITEM_STORE_H
+#define PROCEDURALWORLD_ITEM_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Items of one type stored as parallel arrays, item i is made of the i-th element of every array. Passes over the
+// items only touch the arrays they need, and each array is contiguous so those passes can be vectorized.
+struct ItemStore {
+    vector<float> x;          // Translation on the x-axis
+    vector<float> z;          // Translation on the z-axis
+    vector<float> y;          // Height of the terrain under the item
+    vector<float> itemSize;   // Scaling factor for the widest point of the item
+    vector<float> angle;      // Rotation around the y-axis in degrees
+    vector<uint8_t> leftSide; // 1 if the item is on the left side of the road
+    vector<uint8_t> colorID;  // Index in the tree colors
+
+    [[nodiscard]] size_t count() const { return x.size(); }
+
+    void add(float itemX, float itemZ, float itemY, float size, float itemAngle, bool left, int color) {
+        x.push_back(itemX);
+        z.push_back(itemZ);
+        y.push_back(itemY);
+        itemSize.push_back(size);
+        angle.push_back(itemAngle);
+        leftSide.push_back(left ? 1 : 0);
+        colorID.push_back(static_cast<uint8_t>(color));
+    }
+
+    void reserve(size_t itemCount) {
+        forEachArray([itemCount](uint32_t, auto &array) { array.reserve(itemCount); });
+    }
+
+    void clear() {
+        forEachArray([](uint32_t, auto &array) { array.clear(); });
+    }
+
+    // True if every array holds the same number of items, which is only false for a store read from a bad file
+    [[nodiscard]] bool hasMatchingArrays() const {
+        bool matching = true;
+        forEachArray([&](uint32_t, const auto &array) { matching = matching && array.size() == count(); });
+        return matching;
+    }
+
+    // Calls visit(field, array) for every array, the field numbers are stable and used in chunk files
+    template<class Visitor>
+    void forEachArray(Visitor &&visit) {
+        visit(0, x);
+        visit(1, z);
+        visit(2, y);
+        visit(3, itemSize);
+        visit(4, angle);
+        visit(5, leftSide);
+        visit(6, colorID);
+    }
+
+    template<class Visitor>
+    void forEachArray(Visitor &&visit) const {
+        const_cast<ItemStore *>(this)->forEachArray([&](uint32_t field, auto &array) {
+            visit(field, std::as_const(array));
+        });
+    }
+
+    static constexpr uint32_t FIELD_COUNT = 7;
+};
+
+#endif //PROCEDURALWORLD_ITEM_STORE_H
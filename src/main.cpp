@@ -4,24 +4,35 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "shaders.h" // Note that GL is already included in shaders.h
+#include "chunk_cache.h"
+#include "chunk_coord.h"
+#include "chunk_prefetch.h"
+#include "chunk_store.h"
+#include "chunk_workers.h"
+#include "frustum.h"
+#include "part_meshes.h"
+#include "prop_parts.h"
+#include "terrain.h"
+#include "world.h"
+#include "world_random.h"
 #include <glm/glm.hpp>  // GLM is an optimized math library with syntax to similar to OpenGL Shading Language
 #include <GLFW/glfw3.h> // GLFW provides a cross-platform interface for creating a graphical context,
 #include <stb_image.h>
 
 #include <algorithm>
+#include <cstddef>
 #include <vector>
 #include <map>
-#include <random>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 
 float rotX = 0.0f;
 int camNum = 3;
 bool carLight = false;
 int skyNum = 1;
 
-struct WorldChunk;
-map<int, WorldChunk> chunksByPosition; // Will hold all previous chunk position information for history
-
 unsigned int indexCount;
 
 GLuint createTexturedCubeVAO();
@@ -30,14 +41,65 @@ GLuint createSphereObject();
 
 GLuint loadTexture(const char *filename);
 
+GLuint loadMaterialTextureArray(GLuint &averageColorTexture);
+
 GLuint loadCubemap(vector<std::string> faces);
 
 GLuint createSkyboxObject();
 
-void renderScene(GLuint shader, GLuint texturedCubeVAO, GLuint sphereVAO, float cameraPosZ, GLuint roadTextureID,
-                 GLuint dirtTextureID, GLuint woodTextureID, GLuint leavesTextureID,
-                 GLuint carTextureID, GLuint tireTextureID, GLuint furTextureID, GLuint eyeTextureID, vec3 carMove,
-                 const mat4 &carTransform);
+void setChunkCacheCapacity(size_t capacity);
+
+void setChunkViewRadius(int radius);
+
+void setChunkThreadCount(unsigned int threadCount);
+
+void startChunkWorkers();
+
+void stopChunkWorkers();
+
+void updateChunks(vec3 cameraPosition, vec3 cameraVelocity);
+
+void releaseChunks();
+
+void openChunkStore(const char *directory);
+
+// Chunks and props of chunks drawn and skipped by a pass
+struct CullStats {
+    uint32_t chunksDrawn = 0;
+    uint32_t chunksCulled = 0;
+    uint32_t propsDrawn = 0;
+    uint32_t propsCulled = 0;
+    uint32_t propsSimplified = 0; // Drawn at a coarser level of detail than the full one
+    uint32_t propsAsImpostors = 0; // Of the simplified ones, drawn as an impostor
+};
+
+// A tree drawn as an impostor quad, see IMPOSTOR_VERT
+struct ImpostorInstance {
+    vec4 centerRadius;
+    vec4 colorLayer; // Tint, and the layer of the impostor atlas array
+};
+
+// How a pass sees the scene: the frustum it culls against, and the point props that look too small are judged from
+struct PassView {
+    Frustum frustum;
+    vec3 eye = vec3(0.0f);
+    float minPropSize = 0.0f; // Props whose diameter over their distance from eye is smaller are skipped, 0 keeps all
+    vector<ImpostorInstance> *impostors = nullptr; // Collects the props drawn as impostors, null draws none
+};
+
+// The color pass shades the scene, the depth pass only fills the shadow map and skips everything but positions
+enum RenderPass {
+    COLOR_PASS, DEPTH_PASS
+};
+
+template<RenderPass pass>
+CullStats renderScene(ShaderProgram &shader, GLuint texturedCubeVAO, GLuint sphereVAO, vec3 cameraPosition,
+                      const PassView &view, GLuint roadTextureID, GLuint dirtTextureID, const mat4 &carTransform);
+
+// Projection of the headlight's shadow map, fitted to the part of the light's cone that the camera sees and snapped
+// to the map's texels
+mat4 fitShadowProjection(const Frustum &cameraFrustum, vec3 cameraPosition, const mat4 &lightViewMatrix,
+                         float tanHalfAngle, float nearPlane, float farPlane, unsigned int mapSize);
 
 // Translation keyboard input variables
 float fov = 70.0f;
@@ -51,497 +113,605 @@ GLFWwindow *window = nullptr;
 
 bool InitContext();
 
+// GPU copy of a part list, read per instance by drawPartBatches(). It is only created and destroyed on the render
+// thread, which owns the GL context.
+class PartInstanceBuffer {
+public:
+    PartInstanceBuffer() = default;
+    
+    explicit PartInstanceBuffer(const vector<PartInstance> &instances, GLenum usage = GL_STATIC_DRAW) {
+        upload(instances, usage);
+    }
+    
+    ~PartInstanceBuffer() {
+        release();
+    }
+    
+    PartInstanceBuffer(PartInstanceBuffer &&other) noexcept {
+        *this = std::move(other);
+    }
+    
+    PartInstanceBuffer &operator=(PartInstanceBuffer &&other) noexcept {
+        if (this != &other) {
+            release();
+            buffer = other.buffer;
+            other.buffer = 0;
+        }
+        return *this;
+    }
+    
+    // Replaces the whole content, the old storage is orphaned so a buffer still read by the GPU never stalls
+    void upload(const vector<PartInstance> &instances, GLenum usage = GL_STATIC_DRAW) {
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(PartInstance), instances.data(), usage);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    
+    [[nodiscard]] GLuint getBuffer() const { return buffer; }
 
-struct TexturedColoredVertex {
-    TexturedColoredVertex(vec3 _position, vec3 _normal, vec2 _uv)
-            : position(_position), normal(_normal), uv(_uv) {}
+private:
+    void release() {
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
     
-    vec3 position;
-    vec3 normal;
-    vec2 uv;
+    GLuint buffer = 0;
 };
 
+// One identity instance, instance attributes point at it whenever no part buffer is being drawn
+GLuint defaultInstanceBuffer = 0;
 
-// Cube model
-const TexturedColoredVertex texturedCubeVertexArray[] = {  // position, normal, uv
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)), //left
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, 0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(0.0f, 1.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)),
-        
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(1.0f, 0.0f)),
-        
-        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(1.0f, 1.0f)), // far
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(0.0f, 0.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(0.0f, 1.0f)),
-        
-        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(1.0f, 1.0f)),
-        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(1.0f, 0.0f)),
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(0.0f, 0.0f)),
-        
-        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(1.0f, 1.0f)), // bottom
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(0.0f, 0.0f)),
-        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(1.0f, 0.0f)),
-        
-        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(1.0f, 1.0f)),
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, 0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(0.0f, 1.0f)),
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(0.0f, 0.0f)),
-        
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(0.0f, 1.0f)), // near 
-        TexturedColoredVertex(vec3(-0.5f, -0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(0.0f, 0.0f)),
-        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(1.0f, 0.0f)),
+// Points the instance attributes of the bound vertex array at the instances of buffer, from instance first on.
+// Locations 4 to 7 are the columns of the model matrix, 8 is the color and 9 the material, see SCENE_VERT.
+void setInstanceAttributes(GLuint buffer, uint32_t first) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    auto offset = static_cast<size_t>(first) * sizeof(PartInstance);
+    for (int column = 0; column < 4; column++) {
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(PartInstance),
+                              (void *) (offset + offsetof(PartInstance, model) + column * sizeof(vec4)));
+    }
+    glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(PartInstance),
+                          (void *) (offset + offsetof(PartInstance, color)));
+    glVertexAttribPointer(9, 2, GL_FLOAT, GL_FALSE, sizeof(PartInstance),
+                          (void *) (offset + offsetof(PartInstance, layer)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Adds the per-instance attributes to a mesh's vertex array, they advance once per instance instead of per vertex
+void enablePartInstancing(GLuint vao) {
+    if (defaultInstanceBuffer == 0) {
+        PartInstance identity{mat4(1.0f), vec3(1.0f), 0.0f, 0.0f, 0u, PropType(0), LOD_ALL};
+        glGenBuffers(1, &defaultInstanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, defaultInstanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(PartInstance), &identity, GL_STATIC_DRAW);
+    }
+    
+    glState.bindVertexArray(vao);
+    for (GLuint location = 4; location <= 9; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    setInstanceAttributes(defaultInstanceBuffer, 0);
+    glState.bindVertexArray(0);
+}
+
+// Draws parts with one instanced draw call per batch, the parts of a batch share their mesh. Every instance picks its
+// own layer of the material texture array, so materials never split a batch. The instances are read from the GPU copy
+// of the part list, in the same order.
+void drawPartBatches(ShaderProgram &shader, const PartInstanceBuffer &instances, const vector<PartBatch> &batches,
+                     const GLuint meshVAOs[PART_MESH_COUNT]) {
+    if (batches.empty()) {
+        return;
+    }
+    
+    shader.use();
+    shader.setInt("useInstancing", true);
+    
+    for (const auto &batch: batches) {
+        glState.bindVertexArray(meshVAOs[batch.mesh]);
+        setInstanceAttributes(instances.getBuffer(), batch.first);
         
-        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(1.0f, 1.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(0.0f, 1.0f)),
-        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(1.0f, 0.0f)),
+        if (batch.mesh == PART_SPHERE) {
+            glDrawElementsInstanced(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0, batch.count);
+        } else {
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, batch.count);
+        }
+    }
+    
+    // The meshes are drawn one at a time again by everything else
+    for (uint32_t mesh = 0; mesh < PART_MESH_COUNT; mesh++) {
+        glState.bindVertexArray(meshVAOs[mesh]);
+        setInstanceAttributes(defaultInstanceBuffer, 0);
+    }
+    shader.setInt("useInstancing", false);
+}
+
+// Whether the static meshes of all chunks are drawn with one multi-draw indirect call (GL 4.3), otherwise with one
+// draw call per chunk. Turned off by --multi-draw 0 and when the context does not support it.
+bool multiDrawIndirect = true;
+
+// One GPU buffer of elements shared by many owners, each owning a range of it. The buffer grows when it is full,
+// ranges never move. Only created and used on the render thread.
+template<class Element>
+class GpuArena {
+public:
+    explicit GpuArena(uint32_t initialCapacity) : initialCapacity(initialCapacity) {}
+    
+    // Copies elements into a free range and returns its first element
+    uint32_t allocate(const vector<Element> &elements) {
+        auto count = static_cast<uint32_t>(elements.size());
+        if (count == 0) {
+            return 0;
+        }
         
-        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)), // right 
-        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)),
-        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(1.0f, 0.0f)),
+        size_t range = findFreeRange(count);
+        if (range == freeRanges.size()) {
+            grow(capacity + count);
+            range = findFreeRange(count);
+        }
+        uint32_t first = freeRanges[range].first;
+        freeRanges[range].first += count;
+        freeRanges[range].second -= count;
+        if (freeRanges[range].second == 0) {
+            freeRanges.erase(freeRanges.begin() + static_cast<ptrdiff_t>(range));
+        }
         
-        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)),
-        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)),
-        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(0.0f, 1.0f)),
+        // Uploaded through the copy target, binding an array or element buffer could change the bound vertex array
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(Element), count * sizeof(Element), elements.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return first;
+    }
+    
+    // Returns a range to the free list, merged with its free neighbours
+    void release(uint32_t first, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        auto next = lower_bound(freeRanges.begin(), freeRanges.end(), make_pair(first, 0u));
+        next = freeRanges.insert(next, make_pair(first, count));
+        if (next + 1 != freeRanges.end() && next->first + next->second == (next + 1)->first) {
+            next->second += (next + 1)->second;
+            freeRanges.erase(next + 1);
+        }
+        if (next != freeRanges.begin() && (next - 1)->first + (next - 1)->second == next->first) {
+            (next - 1)->second += next->second;
+            freeRanges.erase(next);
+        }
+    }
+    
+    // Deletes the buffer, all ranges must have been released. Has to run while the GL context still exists.
+    void clear() {
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        capacity = 0;
+        freeRanges.clear();
+        generation++;
+    }
+    
+    // Changes when the arena grows
+    [[nodiscard]] GLuint getBuffer() const { return buffer; }
+    
+    // Counts the buffer replacements. A deleted buffer's name can be handed out again by a later grow, so users that
+    // point at the buffer compare this instead of the name.
+    [[nodiscard]] uint32_t getGeneration() const { return generation; }
+
+private:
+    // Index of the first free range that holds count elements, freeRanges.size() if there is none
+    [[nodiscard]] size_t findFreeRange(uint32_t count) const {
+        for (size_t i = 0; i < freeRanges.size(); i++) {
+            if (freeRanges[i].second >= count) {
+                return i;
+            }
+        }
+        return freeRanges.size();
+    }
+    
+    // Moves the elements to a larger buffer, the added space becomes free
+    void grow(uint32_t minCapacity) {
+        uint32_t newCapacity = std::max({minCapacity, capacity * 2, initialCapacity});
+        GLuint newBuffer = 0;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * sizeof(Element), nullptr, GL_DYNAMIC_DRAW);
+        if (buffer != 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity * sizeof(Element));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
         
-        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(1.0f, 1.0f)), // top 
-        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(1.0f, 0.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(0.0f, 0.0f)),
+        release(capacity, newCapacity - capacity);
+        buffer = newBuffer;
+        capacity = newCapacity;
+        generation++;
+    }
+    
+    uint32_t initialCapacity;
+    GLuint buffer = 0;
+    uint32_t capacity = 0;
+    uint32_t generation = 0;
+    vector<pair<uint32_t, uint32_t>> freeRanges; // First element and count, sorted and never adjacent
+};
+
+// Vertices and indices of the static meshes of all resident chunks, drawn through one vertex array. The indices of a
+// chunk start at 0 and are offset by the chunk's first vertex when drawn.
+class StaticGeometry {
+public:
+    GpuArena<StaticVertex> vertices{1u << 18}; // About 20 chunks, it grows for more
+    GpuArena<uint32_t> indices{1u << 20};
+    
+    // Binds the vertex array, pointed at the current buffers of the arenas. The transform is the identity instance,
+    // color and material are per vertex (locations 8 and 9), see SCENE_VERT.
+    void bind() {
+        if (vao == 0) {
+            glGenVertexArrays(1, &vao);
+        }
+        glState.bindVertexArray(vao);
+        if (vertexGeneration == vertices.getGeneration() && indexGeneration == indices.getGeneration()) {
+            return;
+        }
+        vertexGeneration = vertices.getGeneration();
+        indexGeneration = indices.getGeneration();
+        
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.getBuffer());
+        glBindBuffer(GL_ARRAY_BUFFER, vertices.getBuffer());
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(StaticVertex),
+                              (void *) offsetof(StaticVertex, position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, uv));
+        glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, color));
+        glVertexAttribPointer(9, 2, GL_FLOAT, GL_FALSE, sizeof(StaticVertex), (void *) offsetof(StaticVertex, layer));
+        for (GLuint location: {0, 1, 2, 8, 9}) {
+            glEnableVertexAttribArray(location);
+        }
         
-        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(1.0f, 1.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(0.0f, 0.0f)),
-        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(0.0f, 1.0f))
+        glBindBuffer(GL_ARRAY_BUFFER, defaultInstanceBuffer);
+        for (GLuint column = 0; column < 4; column++) {
+            glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(PartInstance),
+                                  (void *) (offsetof(PartInstance, model) + column * sizeof(vec4)));
+            glVertexAttribDivisor(4 + column, 1);
+            glEnableVertexAttribArray(4 + column);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    
+    // Has to run while the GL context still exists, after every chunk was released
+    void clear() {
+        if (vao != 0) {
+            glState.deleteVertexArray(vao);
+        }
+        vao = 0;
+        vertexGeneration = indexGeneration = 0;
+        vertices.clear();
+        indices.clear();
+    }
+
+private:
+    GLuint vao = 0;
+    uint32_t vertexGeneration = 0; // Generations of the arena buffers the vertex array points at
+    uint32_t indexGeneration = 0;
 };
 
+StaticGeometry staticGeometry;
 
-//Function to draw bushes
-void drawBush(GLuint shader, float z, float x, float initial, int draw, GLuint text) {
-    if (draw == 1) {
-        mat4 bushMatrix =
-                translate(mat4(1.0f), vec3(initial + x, 1.0f, 0.0f + z)) *
-                rotate(mat4(1.0f), radians(90.0f), vec3(0.0f, 1.0f, 0.0f)) * scale(mat4(1.0f), vec3(2.0f, 2.0f, 2.0f));
-        glBindTexture(GL_TEXTURE_2D, text);
-        SetUniformMat4(shader, "model_matrix", bushMatrix);
-        SetUniformVec3(shader, "object_color", vec3(0.0f, 1.0f, 0.5f)); // Green
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+// Command layout read by glMultiDrawElementsIndirect()
+struct DrawElementsIndirectCommand {
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+// A chunk's static mesh in the static geometry, released when the chunk is evicted
+class StaticMeshRange {
+public:
+    StaticMeshRange() = default;
+    
+    explicit StaticMeshRange(const StaticMesh &mesh)
+            : firstVertex(staticGeometry.vertices.allocate(mesh.vertices)),
+              vertexCount(static_cast<uint32_t>(mesh.vertices.size())),
+              firstIndex(staticGeometry.indices.allocate(mesh.indices)),
+              indexCount(static_cast<uint32_t>(mesh.indices.size())) {}
+    
+    ~StaticMeshRange() {
+        release();
     }
     
-}
+    StaticMeshRange(StaticMeshRange &&other) noexcept {
+        *this = std::move(other);
+    }
+    
+    StaticMeshRange &operator=(StaticMeshRange &&other) noexcept {
+        if (this != &other) {
+            release();
+            firstVertex = other.firstVertex;
+            vertexCount = other.vertexCount;
+            firstIndex = other.firstIndex;
+            indexCount = other.indexCount;
+            other.vertexCount = other.indexCount = 0;
+        }
+        return *this;
+    }
+    
+    // Draws count indices of the mesh from index first on
+    [[nodiscard]] DrawElementsIndirectCommand drawCommand(uint32_t first, uint32_t count) const {
+        return DrawElementsIndirectCommand{count, 1, firstIndex + first, static_cast<int32_t>(firstVertex), 0};
+    }
 
-void drawSquirrel(GLuint shader_id, float size, int vaos, float x, float z, vec3 colorChoice, GLuint furr, GLuint eyeTex, float angle) {
-    //bind furr
-    
-    glBindTexture(GL_TEXTURE_2D, furr);
-    
-    mat4 squirrel;
-    float sizeInc = size;
-    mat4 reposition = translate(mat4(1.0f), vec3(x, 0, z)) * rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f)) ;//position squirrel in scene
-    vec3 color= colorChoice;
-    
-    SetUniform1Value(shader_id, "interpolateColor", true);
-    SetUniformVec3(shader_id, "object_color", color);
-    
-    mat4 body = translate(mat4(1.0f), sizeInc*vec3(0 , 1.5f, 0.0f)) * scale(mat4(1.0f), sizeInc*vec3(1, 2.0f, 0.8f));
-    squirrel = reposition * body;
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 foot1 = translate(mat4(1.0f), sizeInc*vec3(-0.5f, 0.7, 0.3f)) * scale(mat4(1.0f), sizeInc*vec3(0.4f, 0.3f, 0.5f));
-    squirrel = reposition * foot1;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 foot2 = translate(mat4(1.0f), sizeInc*vec3(0.5f, 0.7, 0.3f)) * scale(mat4(1.0f), sizeInc*vec3(0.4f, 0.3f, 0.5f));
-    squirrel = reposition * foot2;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 head = translate(mat4(1.0f), sizeInc*vec3(0 , 2.8, 0.5 )) * scale(mat4(1.0f), sizeInc*vec3(0.5f, 0.5f, 0.7));
-    squirrel = reposition * head;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 neck = translate(mat4(1.0f), sizeInc*vec3(0, 2 , 0.3 )) * scale(mat4(1.0f), sizeInc*vec3(0.2, 2, 0.2));
-    squirrel = reposition * neck;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 arms = translate(mat4(1.0f), sizeInc*vec3(0 , 2 , 0.0f)) * scale(mat4(1.0f), sizeInc*vec3(1.5, 0.3f, 0.3f));
-    squirrel = reposition * arms;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 tail = translate(mat4(1.0f), sizeInc*vec3(0 , 0.7, -0.8f)) *scale(mat4(1.0f), sizeInc*vec3(0.5, 0.3f, 1.5f));
-    squirrel = reposition *tail;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 ear1 = translate(mat4(1.0f), sizeInc*vec3(0.2, 3.1, 0.2 )) * scale(mat4(1.0f), sizeInc*vec3(0.1f, 0.1f, 0.1));
-    squirrel = reposition * ear1;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 ear2 = translate(mat4(1.0f), sizeInc*vec3(-0.2 , 3.1, 0.2 )) * scale(mat4(1.0f), sizeInc*vec3(0.1f, 0.1f, 0.1));
-    squirrel = reposition * ear2;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    glBindVertexArray(vaos);
-    glBindTexture(GL_TEXTURE_2D, eyeTex);
-    SetUniform1Value(shader_id, "interpolateColor", false);
-    
-    mat4 eye1 = translate(mat4(1.0f), sizeInc*vec3(-0.2 , 2.8 , 0.5 )) * scale(mat4(1.0f), sizeInc*vec3(0.15f, 0.15f, 0.15f));
-    squirrel = reposition * eye1;
-    SetUniformVec3(shader_id, "object_color", vec3(0, 0, 0));
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-    
-    mat4 eye2 = translate(mat4(1.0f), sizeInc*vec3(0.2 , 2.8 , 0.5 )) * scale(mat4(1.0f), sizeInc* vec3(0.15f, 0.15f, 0.15f));
-    squirrel = reposition * eye2;
-    SetUniformVec3(shader_id, "object_color", vec3(0, 0, 0));
-    SetUniformMat4(shader_id, "model_matrix", squirrel);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+private:
+    void release() {
+        staticGeometry.vertices.release(firstVertex, vertexCount);
+        staticGeometry.indices.release(firstIndex, indexCount);
+    }
     
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+};
+
+// Buffer the draw commands are streamed through, reused by every pass
+GLuint staticIndirectBuffer = 0;
+
+// Draws the static meshes of the chunks, one command per chunk. With multi-draw indirect all of them are one call,
+// however many chunks and props there are, otherwise every chunk is one call from the same vertex array.
+void drawStaticMeshes(ShaderProgram &shader, const vector<DrawElementsIndirectCommand> &commands) {
+    if (commands.empty()) {
+        return;
+    }
+    
+    shader.use();
+    shader.setInt("useInstancing", true);
+    staticGeometry.bind();
+    
+    if (multiDrawIndirect) {
+        if (staticIndirectBuffer == 0) {
+            glGenBuffers(1, &staticIndirectBuffer);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, staticIndirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(),
+                     GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        for (const auto &command: commands) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), GL_UNSIGNED_INT,
+                                     (void *) (command.firstIndex * sizeof(uint32_t)), command.baseVertex);
+        }
+    }
+    
+    shader.setInt("useInstancing", false);
 }
 
-// For randomized tree leaves colors
-vec3 green = vec3(0.0f, 1.0f, 0.0f);
-vec3 darkyellow = vec3(0.545f, 0.573f, 0.086f);
-vec3 lightgold = vec3(0.655f, 0.624f, 0.059f);
-vec3 marigold = vec3(0.545f, 0.573f, 0.086f);
-vec3 fulvous = vec3(0.914f, 0.525f, 0.016f);
-vec3 sinopia = vec3(0.875, 0.224, 0.031);
-vec3 treeColor[6] = {green, darkyellow, lightgold, marigold, fulvous, sinopia};
-
-//Draws the tree
-void drawTree(GLuint shader, float z, float x, float initial, int tree, GLuint woodText, GLuint leafText, int color) {
-    
-    if (tree == 1) {
-        mat4 scaleDown = scale(mat4(1.0f), vec3(0.75f));
-        mat4 translateXZ = translate(mat4(1.0f), vec3(x, 0.0f, z));
-        
-        //Trunk
-        glBindTexture(GL_TEXTURE_2D, woodText);
-        
-        mat4 trunkMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 5.0f, 0.0f)) * scale(mat4(1.0f), vec3(3.0f, 20.0f, 3.0f));
-        trunkMatrix = translateXZ * scaleDown * trunkMatrix;
-        SetUniformMat4(shader, "model_matrix", trunkMatrix);
-        SetUniformVec3(shader, "object_color", vec3(0.267f, 0.129f, 0.004f)); // Brown
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        //Top leaves
-        glBindTexture(GL_TEXTURE_2D, leafText);
-        SetUniform1Value(shader, "interpolateColor", true);
-        SetUniformVec3(shader, "object_color", treeColor[color]); // Green
-        
-        mat4 leavesMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 10.0f, 0.0f)) * scale(mat4(1.0f), vec3(12.0f, 2.0f, 12.0f));
-        leavesMatrix = translateXZ * scaleDown * leavesMatrix;
-        SetUniformMat4(shader, "model_matrix", leavesMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        leavesMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 12.0f, 0.0f)) * scale(mat4(1.0f), vec3(10.0f, 2.0f, 10.0f));
-        leavesMatrix = translateXZ * scaleDown * leavesMatrix;
-        SetUniformMat4(shader, "model_matrix", leavesMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        leavesMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 14.0f, 0.0f)) * scale(mat4(1.0f), vec3(8.0f, 2.0f, 8.0f));
-        leavesMatrix = translateXZ * scaleDown * leavesMatrix;
-        SetUniformMat4(shader, "model_matrix", leavesMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        leavesMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 16.0f, 0.0f)) * scale(mat4(1.0f), vec3(6.0f, 2.0f, 6.0f));
-        leavesMatrix = translateXZ * scaleDown * leavesMatrix;
-        SetUniformMat4(shader, "model_matrix", leavesMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        leavesMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 18.0f, 0.0f)) * scale(mat4(1.0f), vec3(4.0f, 2.0f, 4.0f));
-        leavesMatrix = translateXZ * scaleDown * leavesMatrix;
-        SetUniformMat4(shader, "model_matrix", leavesMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        leavesMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 20.0f, 0.0f)) * scale(mat4(1.0f), vec3(2.0f, 2.0f, 2.0f));
-        leavesMatrix = translateXZ * scaleDown * leavesMatrix;
-        SetUniformMat4(shader, "model_matrix", leavesMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        leavesMatrix =
-                translate(mat4(1.0f), vec3(0.0f, 21.5f, 0.0f)) * scale(mat4(1.0f), vec3(1.0f, 1.0f, 1.0f));
-        leavesMatrix = translateXZ * scaleDown * leavesMatrix;
-        SetUniformMat4(shader, "model_matrix", leavesMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36); // 36 vertices, starting at index 0
-        
-        SetUniform1Value(shader, "interpolateColor", false);
-        
-    } else if (tree == 2) {
-        //Trunk
-        mat4 groundWorldMatrix =
-                translate(mat4(1.0f), vec3(x, 3.0f, z)) * scale(mat4(1.0f), vec3(1.0f, 6.0f, 1.0f));
-        glBindTexture(GL_TEXTURE_2D, woodText);
-        SetUniformVec3(shader, "object_color", vec3(150.0 / 255.0, 75.0 / 255.0, 0.0f));
-        SetUniformMat4(shader, "model_matrix", groundWorldMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        
-        //Leaves
-        groundWorldMatrix =
-                translate(mat4(1.0f), vec3(x, 7.5f, z)) * scale(mat4(1.0f), vec3(4.0f, 3.0f, 4.0f));
-        glBindTexture(GL_TEXTURE_2D, leafText);
-        SetUniformVec3(shader, "object_color", vec3(0.0, 1.0, 0.0f));
-        SetUniformMat4(shader, "model_matrix", groundWorldMatrix);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+// Layers of the impostor atlas array, one per tree archetype, see WorldChunk::treeImpostors()
+GLuint impostorAtlasArray = 0;
+
+// Which archetypes' atlases are on the GPU
+vector<uint8_t> impostorUploaded;
+
+// Uploads the atlases the workers finished baking since the last frame. The array stays bound to texture unit 3.
+void uploadBakedImpostors() {
+    ImpostorLibrary &library = WorldChunk::treeImpostors();
+    if (impostorAtlasArray == 0) {
+        glGenTextures(1, &impostorAtlasArray);
+        glState.activeTexture(GL_TEXTURE3);
+        glState.bindTexture(GL_TEXTURE_2D_ARRAY, impostorAtlasArray);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // The smallest mipmaps would blend neighbouring cells
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 4);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE,
+                     static_cast<GLsizei>(library.count()), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glState.activeTexture(GL_TEXTURE0);
+        impostorUploaded.assign(library.count(), 0);
+    }
+    
+    bool uploaded = false;
+    for (uint32_t archetype = 0; archetype < library.count(); archetype++) {
+        if (impostorUploaded[archetype] || !library.isBaked(archetype)) {
+            continue;
+        }
+        if (!uploaded) {
+            glState.activeTexture(GL_TEXTURE3);
+            glState.bindTexture(GL_TEXTURE_2D_ARRAY, impostorAtlasArray);
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(archetype), IMPOSTOR_ATLAS_SIZE,
+                        IMPOSTOR_ATLAS_SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE, library.atlas(archetype).data());
+        impostorUploaded[archetype] = 1;
+        uploaded = true;
+    }
+    if (uploaded) {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glState.activeTexture(GL_TEXTURE0);
     }
 }
 
-void
-drawRabbit(GLuint shader_id, float size, int vaos, float x, float z, vec3 colorChoice, GLuint furr, GLuint eyeTex, float angle) {
-    //bind furr
-    
-    glBindTexture(GL_TEXTURE_2D, furr);
-    mat4 rabbit;
-    mat4 rotation = rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f));
-    
-    float sizeInc = size;
-    mat4 reposition = translate(mat4(1.0f), vec3(x, -0.03f, z)) * rotation;//position rabbit in scene
-    vec3 color = colorChoice;
-    
-    mat4 body = translate(mat4(1.0f), sizeInc * vec3(0.0f, 1.0f, 0.0f)) *
-                scale(mat4(1.0f), sizeInc * vec3(3.5f, 2.0f, 3.0f));
-    rabbit = reposition * body;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", rabbit);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 head = translate(mat4(1.0f), sizeInc * vec3(-1.25f, 2.5f, 0.0f)) *
-                scale(mat4(1.0f), sizeInc * vec3(2.0f, 1.0f, 1.5f));
-    rabbit = reposition * head;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", rabbit);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 ear1 = translate(mat4(1.0f), sizeInc * vec3(-0.75f, 3.75f, -0.5f)) *
-                scale(mat4(1.0f), sizeInc * vec3(0.5f, 1.5f, 0.5f));
-    rabbit = reposition * ear1;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", rabbit);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 ear2 = translate(mat4(1.0f), sizeInc * vec3(-0.75f, 3.75f, 0.5f)) *
-                scale(mat4(1.0f), sizeInc * vec3(0.5f, 1.5f, 0.5));
-    rabbit = reposition * ear2;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", rabbit);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    glBindTexture(GL_TEXTURE_2D, eyeTex);
-    
-    glBindVertexArray(vaos);
-    mat4 eye1 = translate(mat4(1.0f), sizeInc * vec3(-1.25f, 2.5f, 0.7f)) *
-                rotate(mat4(1.0f), radians(90.0f), vec3(0.0f, 1.0f, 0.0f)) *
-                scale(mat4(1.0f), sizeInc * vec3(0.3f, 0.3f, 0.3f));
-    rabbit = reposition * eye1;
-    SetUniformVec3(shader_id, "object_color", vec3(0, 0, 0));
-    SetUniformMat4(shader_id, "model_matrix", rabbit);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-    
-    mat4 eye2 = translate(mat4(1.0f), sizeInc * vec3(-1.25f, 2.5f, -0.7f)) *
-                rotate(mat4(1.0f), radians(-90.0f), vec3(0.0f, 1.0f, 0.0f)) *
-                scale(mat4(1.0f), sizeInc * vec3(0.3f, 0.3f, 0.3f));
-    rabbit = reposition * eye2;
-    SetUniformVec3(shader_id, "object_color", vec3(0, 0, 0));
-    SetUniformMat4(shader_id, "model_matrix", rabbit);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-    
-    glBindTexture(GL_TEXTURE_2D, furr);
-    
-    mat4 tail = translate(mat4(1.0f), sizeInc * vec3(2.0f, 1.0f, 0.0f)) *
-                scale(mat4(1.0f), sizeInc * vec3(0.5f, 0.5f, 0.5f));
-    rabbit = reposition * tail;
-    SetUniformVec3(shader_id, "object_color", color);
-    SetUniformMat4(shader_id, "model_matrix", rabbit);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+// Whether a prop of the chunk, numbered in mesh order, can be drawn as its impostor
+bool impostorReady(const WorldChunk &chunk, size_t prop) {
+    uint32_t impostor = chunk.propImpostors[prop];
+    return impostor != WorldChunk::NO_IMPOSTOR && impostorUploaded[chunk.impostors[impostor].archetype];
+}
+
+// Unit quad the impostors are drawn with, and the buffer their instances are streamed through
+GLuint impostorVAO = 0;
+GLuint impostorInstanceBuffer = 0;
+
+// Draws every impostor in one instanced call of a camera-facing quad
+void drawImpostors(ShaderProgram &shader, const vector<ImpostorInstance> &instances) {
+    if (instances.empty()) {
+        return;
+    }
     
+    if (impostorVAO == 0) {
+        const vec2 corners[4] = {vec2(-1.0f, -1.0f), vec2(1.0f, -1.0f), vec2(-1.0f, 1.0f), vec2(1.0f, 1.0f)};
+        GLuint cornerBuffer;
+        glGenVertexArrays(1, &impostorVAO);
+        glGenBuffers(1, &cornerBuffer);
+        glGenBuffers(1, &impostorInstanceBuffer);
+        glState.bindVertexArray(impostorVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cornerBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), (void *) 0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, impostorInstanceBuffer);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance),
+                              (void *) offsetof(ImpostorInstance, centerRadius));
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance),
+                              (void *) offsetof(ImpostorInstance, colorLayer));
+        for (GLuint location = 1; location <= 2; location++) {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
     
+    shader.use();
+    glState.bindVertexArray(impostorVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, impostorInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(ImpostorInstance), instances.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(instances.size()));
+    glState.bindVertexArray(0);
 }
 
-void drawCar(GLuint shader_id, const mat4 &grpMatrix, int vaos, vec3 carMove, GLuint carText,
-             GLuint tireText) {
-    glBindTexture(GL_TEXTURE_2D, carText);
-    mat4 car;
-    float sizeInc = 1;//make car dif size
-    
-    mat4 body = scale(mat4(1.0f), vec3(4.0f, 1.5f, 8.0f));
-    car = grpMatrix * body;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 light1 = translate(mat4(1.0f), vec3(-1.25, 0.0f, -4.0f)) *
-                  scale(mat4(1.0f), vec3(0.5f, 0.5f, 0.1f));
-    car = grpMatrix * light1;
-    SetUniformVec3(shader_id, "object_color", vec3(0, 1, 1));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 light2 = translate(mat4(1.0f), vec3(1.25f, 0.0f, -4.0f)) *
-                  scale(mat4(1.0f), vec3(0.5f, 0.5f, 0.1f));
-    car = grpMatrix * light2;
-    SetUniformVec3(shader_id, "object_color", vec3(0, 1, 1));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side1 = translate(mat4(1.0f), vec3(-1.5f, 1.5, 2)) *
-                 scale(mat4(1.0f), vec3(0.1f, 1.75, 3));
-    car = grpMatrix * side1;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side1_2 = translate(mat4(1.0f), vec3(-1.5f, 2.23, -1)) *
-                   scale(mat4(1.0f), vec3(0.1f, 0.3, 3));
-    car = grpMatrix * side1_2;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side1_3 = translate(mat4(1.0f), vec3(-1.5f, 0.75, -1)) *
-                   scale(mat4(1.0f), vec3(0.1f, 0.3, 3));
-    car = grpMatrix * side1_3;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side1_4 = translate(mat4(1.0f), vec3(-1.5f, 1.5, -2)) *
-                   scale(mat4(1.0f), vec3(0.15f, 1.3, 1));
-    car = grpMatrix * side1_4;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side2 = translate(mat4(1.0f), vec3(1.5f, 1.5, 2)) *
-                 scale(mat4(1.0f), vec3(0.1f, 1.75, 3));
-    car = grpMatrix * side2;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side2_2 = translate(mat4(1.0f), vec3(1.5f, 2.23, -1)) *
-                   scale(mat4(1.0f), vec3(0.1f, 0.3, 3));
-    car = grpMatrix * side2_2;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side2_3 = translate(mat4(1.0f), vec3(1.5f, 0.75, -1)) *
-                   scale(mat4(1.0f), vec3(0.1f, 0.3, 3));
-    car = grpMatrix * side2_3;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 side2_4 = translate(mat4(1.0f), vec3(1.5f, 1.5, -2)) *
-                   scale(mat4(1.0f), vec3(0.15f, 1.3, 1));
-    car = grpMatrix * side2_4;
-    SetUniformVec3(shader_id, "object_color", vec3(255 / 255.0, 105 / 255.0, 180 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 window1 = translate(mat4(1.0f), vec3(0.0f, 0.75, -2.5)) *
-                   scale(mat4(1.0f), vec3(3, 0.3, 0.1f));
-    car = grpMatrix * window1;
-    SetUniformVec3(shader_id, "object_color", vec3(1, 0, 0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 window2 = translate(mat4(1.0f), vec3(0.0f, 2.25, -2.5)) *
-                   scale(mat4(1.0f), vec3(3, 0.3, 0.1f));
-    car = grpMatrix * window2;
-    SetUniformVec3(shader_id, "object_color", vec3(1, 0, 0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 back = translate(mat4(1.0f), vec3(0.0f, 1.5, 3.5)) *
-                scale(mat4(1.0f), vec3(3, 1.75, 0.1f));
-    car = grpMatrix * back;
-    SetUniformVec3(shader_id, "object_color", vec3(1, 0, 0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    mat4 top = translate(mat4(1.0f), vec3(0.0f, 2.4, 0.5)) *
-               scale(mat4(1.0f), vec3(3, 0.1, 6.0f));
-    car = grpMatrix * top;
-    SetUniformVec3(shader_id, "object_color", vec3(1, 0, 1));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    
-    glBindTexture(GL_TEXTURE_2D, tireText);
-    glBindVertexArray(vaos);
-    mat4 wheel1 = translate(mat4(1.0f), vec3(2.25f, -0.5f, -2.0f)) *
-                  rotate(mat4(1.0f), radians(rotX), vec3(1, 0, 0)) *
-                  scale(mat4(1.0f), vec3(0.5f, 1.0f, 1.0f));
-    car = grpMatrix * wheel1;
-    SetUniformVec3(shader_id, "object_color", vec3(50 / 255.0, 50 / 255.0, 50 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-    
-    mat4 wheel2 = translate(mat4(1.0f), vec3(2.25f, -0.5f, 2.0f)) *
-                  rotate(mat4(1.0f), radians(rotX), vec3(1, 0, 0)) *
-                  scale(mat4(1.0f), vec3(0.5f, 1.0f, 1.0f));
-    car = grpMatrix * wheel2;
-    SetUniformVec3(shader_id, "object_color", vec3(50 / 255.0, 50 / 255.0, 50 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-    
-    mat4 wheel3 = translate(mat4(1.0f), vec3(-2.25, -0.5f, -2.0f)) *
-                  rotate(mat4(1.0f), radians(rotX), vec3(1, 0, 0)) *
-                  scale(mat4(1.0f), vec3(0.5f, 1.0f, 1.0f));
-    car = grpMatrix * wheel3;
-    SetUniformVec3(shader_id, "object_color", vec3(50 / 255.0, 50 / 255.0, 50 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-    
-    mat4 wheel4 = translate(mat4(1.0f), vec3(-2.25, -0.5f, 2.0f)) *
-                  rotate(mat4(1.0f), radians(rotX), vec3(1, 0, 0)) *
-                  scale(mat4(1.0f), vec3(0.5f, 1.0f, 1.0f));
-    car = grpMatrix * wheel4;
-    SetUniformVec3(shader_id, "object_color", vec3(50 / 255.0, 50 / 255.0, 50 / 255.0));
-    SetUniformMat4(shader_id, "model_matrix", car);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+// Parts of the car relative to the car, of every level of detail. The tires spin around their axle, which commutes
+// with their scale, so the spin is applied last when the car is drawn.
+void buildCarParts(PartListBuilder &parts) {
+    vec3 pink = vec3(255 / 255.0, 105 / 255.0, 180 / 255.0);
+    
+    // Everything but the body is only drawn at full detail
+    auto carPart = [&](vec3 offset, vec3 scaling, vec3 color, uint16_t lods = lodRange(0, 0)) {
+        parts.add(PART_CUBE, PART_CAR, false, translate(mat4(1.0f), offset) * scale(mat4(1.0f), scaling), color, lods);
+    };
+    parts.beginProp(PROP_CAR);
+    carPart(vec3(0.0f, 0.0f, 0.0f), vec3(4.0f, 1.5f, 8.0f), pink, LOD_ALL); // Body
+    carPart(vec3(-1.25, 0.0f, -4.0f), vec3(0.5f, 0.5f, 0.1f), vec3(0, 1, 1)); // Lights
+    carPart(vec3(1.25f, 0.0f, -4.0f), vec3(0.5f, 0.5f, 0.1f), vec3(0, 1, 1));
+    for (float side: {-1.5f, 1.5f}) {
+        carPart(vec3(side, 1.5, 2), vec3(0.1f, 1.75, 3), pink);
+        carPart(vec3(side, 2.23, -1), vec3(0.1f, 0.3, 3), pink);
+        carPart(vec3(side, 0.75, -1), vec3(0.1f, 0.3, 3), pink);
+        carPart(vec3(side, 1.5, -2), vec3(0.15f, 1.3, 1), pink);
+    }
+    carPart(vec3(0.0f, 0.75, -2.5), vec3(3, 0.3, 0.1f), vec3(1, 0, 0));   // Windows
+    carPart(vec3(0.0f, 2.25, -2.5), vec3(3, 0.3, 0.1f), vec3(1, 0, 0));
+    carPart(vec3(0.0f, 1.5, 3.5), vec3(3, 1.75, 0.1f), vec3(1, 0, 0));    // Back
+    carPart(vec3(0.0f, 2.4, 0.5), vec3(3, 0.1, 6.0f), vec3(1, 0, 1));     // Top
+    carPart(vec3(0.0f, 1.5f, 0.5f), vec3(3.2f, 1.9f, 6.0f), pink, lodRange(1, 1)); // Whole cabin
+    
+    for (vec3 wheel: {vec3(2.25f, -0.5f, -2.0f), vec3(2.25f, -0.5f, 2.0f), vec3(-2.25, -0.5f, -2.0f),
+                      vec3(-2.25, -0.5f, 2.0f)}) {
+        mat4 tire = translate(mat4(1.0f), wheel) * scale(mat4(1.0f), vec3(0.5f, 1.0f, 1.0f));
+        parts.add(PART_SPHERE, PART_TIRE, false, tire, vec3(50 / 255.0, 50 / 255.0, 50 / 255.0), lodRange(0, 0));
+        parts.add(PART_CUBE, PART_TIRE, false, tire * scale(mat4(1.0f), vec3(1.8f)),
+                  vec3(50 / 255.0, 50 / 255.0, 50 / 255.0), lodRange(1, 1));
+    }
+}
+
+// GPU copy of the car's parts placed in the scene, streamed every frame. Released by releaseCarInstances() before the
+// context is destroyed.
+PartInstanceBuffer carInstances;
+
+void releaseCarInstances() {
+    carInstances = PartInstanceBuffer();
+}
+
+// Draws the car at the level of detail for its distance from the camera
+void drawCar(ShaderProgram &shader, const mat4 &grpMatrix, vec3 cameraPosition,
+             const GLuint meshVAOs[PART_MESH_COUNT]) {
+    // The car's own parts never change, only their placement in the scene does
+    static vector<PartInstance> carLODParts[PROP_LOD_COUNT];
+    static vector<PartBatch> carLODPartBatches[PROP_LOD_COUNT];
+    static vector<PartInstance> carPartsInScene;
+    static int carLOD = 0;
+    if (carLODParts[0].empty()) {
+        PartListBuilder parts;
+        buildCarParts(parts);
+        for (int level = 0; level < PROP_LODS[PROP_CAR].levels; level++) {
+            parts.build(carLODParts[level], carLODPartBatches[level], level);
+        }
+    }
     
+    carLOD = selectPropLOD(PROP_CAR, length(vec3(grpMatrix[3]) - cameraPosition), carLOD);
+    const vector<PartInstance> &carParts = carLODParts[carLOD];
+    const vector<PartBatch> &carPartBatches = carLODPartBatches[carLOD];
+    
+    mat4 spin = rotate(mat4(1.0f), radians(rotX), vec3(1, 0, 0));
+    carPartsInScene.resize(carParts.size());
+    for (size_t i = 0; i < carParts.size(); i++) {
+        carPartsInScene[i] = carParts[i];
+        carPartsInScene[i].model = grpMatrix * carParts[i].model;
+        if (carParts[i].layer == PART_TIRE) {
+            carPartsInScene[i].model = carPartsInScene[i].model * spin;
+        }
+    }
+    
+    carInstances.upload(carPartsInScene, GL_STREAM_DRAW);
+    drawPartBatches(shader, carInstances, carPartBatches, meshVAOs);
 }
 
 int main(int argc, char *argv[]) {
-    if (!InitContext()) return -1;
+    // The same seed always generates the same world
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0) {
+            setWorldSeed(strtoull(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--chunk-cache") == 0) {
+            setChunkCacheCapacity(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--view-radius") == 0) {
+            setChunkViewRadius(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--chunk-threads") == 0) {
+            setChunkThreadCount(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--chunk-store") == 0) {
+            openChunkStore(argv[++i]);
+        } else if (strcmp(argv[i], "--multi-draw") == 0) {
+            multiDrawIndirect = atoi(argv[++i]) != 0;
+        }
+    }
+    cout << "World seed: " << getWorldSeed() << "\n";
+    
+    // The workers only start once the command line chose how many there are
+    startChunkWorkers();
+    
+    if (!InitContext()) {
+        stopChunkWorkers();
+        return -1;
+    }
+    
+    multiDrawIndirect = multiDrawIndirect && (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect);
+    cout << "Chunk rendering: " << (multiDrawIndirect ? "multi-draw indirect" : "one draw per chunk") << "\n";
     
     // background
     glClearColor(0.41f, 0.44f, 0.62f, 1.0f);
     
-    GLuint shaderScene = compileAndLinkShaders(SCENE_VERT, SCENE_FRAG);
-    GLuint shaderShadow = compileAndLinkShaders(SHADOW_VERT, SHADOW_FRAG);
-    GLuint shaderSkybox = compileAndLinkShaders(SKYBOX_VERT, SKYBOX_FRAG);
+    ShaderProgram shaderScene(SCENE_VERT, SCENE_FRAG);
+    ShaderProgram shaderShadow(SHADOW_VERT, SHADOW_FRAG);
+    ShaderProgram shaderSkybox(SKYBOX_VERT, SKYBOX_FRAG);
+    ShaderProgram shaderImpostor(IMPOSTOR_VERT, IMPOSTOR_FRAG);
     
     // Load Textures
-    GLuint leavesTextureID = loadTexture(PATH_PREFIX "assets/textures/leaves.png");
-    GLuint woodTextureID = loadTexture(PATH_PREFIX "assets/textures/wood.jpg");
     GLuint roadTextureID = loadTexture(PATH_PREFIX "assets/textures/road.jpeg");
     GLuint dirtTextureID = loadTexture(PATH_PREFIX "assets/textures/dirt.png");
-    GLuint carTextureID = loadTexture(PATH_PREFIX "assets/textures/car.jpg");
-    GLuint tireTextureID = loadTexture(PATH_PREFIX "assets/textures/tire.jpg");
-    GLuint furTextureID = loadTexture(PATH_PREFIX "assets/textures/fur.jpg");
-    GLuint eyeTextureID = loadTexture(PATH_PREFIX "assets/textures/eye.jpg");
+    
+    // The prop materials stay bound to texture unit 2 for the whole run, and their average colors, which the
+    // impostors are shaded with, to unit 4
+    GLuint materialColorTexture = 0;
+    GLuint materialTextureArray = loadMaterialTextureArray(materialColorTexture);
+    glState.activeTexture(GL_TEXTURE2);
+    glState.bindTexture(GL_TEXTURE_2D_ARRAY, materialTextureArray);
+    glState.activeTexture(GL_TEXTURE4);
+    glState.bindTexture(GL_TEXTURE_2D, materialColorTexture);
+    glState.activeTexture(GL_TEXTURE0);
     
     vector<std::string> skyFaces1{
             PATH_PREFIX "assets/textures/skybox/right.jpeg",  // right
@@ -589,34 +759,32 @@ int main(int argc, char *argv[]) {
     GLuint cubemapTexture3 = loadCubemap(skyFaces3);
     GLuint cubemapTexture4 = loadCubemap(skyFaces4);
     GLuint cubemapTexture5 = loadCubemap(skyFaces5);
-    glUseProgram(shaderSkybox);
+    shaderSkybox.use();
     vec3 lightColor = vec3(1.0f, 1.0f, 1.0f); // Used for both the scene shader and the skybox shader
-    SetUniformVec3(shaderSkybox, "lightColor", lightColor);
+    shaderSkybox.setVec3("lightColor", lightColor);
     
-    glUseProgram(shaderScene);
-    GLuint textureflag = glGetUniformLocation(shaderScene, "useTexture");
-    GLint p_array[1];
-    GLint *currentvalue = p_array;
+    shaderScene.use();
+    ShaderProgram::Uniform textureflag = shaderScene.uniform("useTexture");
+    ShaderProgram::Uniform shadowflag = shaderScene.uniform("useShadow");
     
-    GLuint shadowflag = glGetUniformLocation(shaderScene, "useShadow");
-    GLint p_arrayS[1];
-    GLint *currentvalueS = p_arrayS;
-    
-    GLuint lightFlag = glGetUniformLocation(shaderScene, "lightsOn");
+    ShaderProgram::Uniform lightFlag = shaderScene.uniform("lightsOn");
     bool toggleLights = true;
-    glUniform1i(lightFlag, toggleLights);
+    shaderScene.setInt(lightFlag, toggleLights);
     
     // Setup texture and framebuffer for creating shadow map
     
     // Dimensions of the shadow texture, which should cover the viewport window size and shouldn't be oversized and waste resources
     const unsigned int DEPTH_MAP_TEXTURE_SIZE = 1024;
     
+    // Props that would cover fewer texels of the shadow map across are not drawn into it
+    const float MIN_SHADOW_CASTER_TEXELS = 2.0f;
+    
     // Variable storing index to texture used for shadow mapping
     GLuint depth_map_texture;
     // Get the texture
     glGenTextures(1, &depth_map_texture);
     // Bind the texture so the next glTex calls affect it
-    glBindTexture(GL_TEXTURE_2D, depth_map_texture);
+    glState.bindTexture(GL_TEXTURE_2D, depth_map_texture);
     // Create the texture and specify it's attributes, including widthn height, components (only depth is stored, no color information)
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, DEPTH_MAP_TEXTURE_SIZE, DEPTH_MAP_TEXTURE_SIZE, 0,
                  GL_DEPTH_COMPONENT, GL_FLOAT,
@@ -637,7 +805,7 @@ int main(int argc, char *argv[]) {
     // Get the framebuffer
     glGenFramebuffers(1, &depth_map_fbo);
     // Bind the framebuffer so the next glFramebuffer calls affect it
-    glBindFramebuffer(GL_FRAMEBUFFER, depth_map_fbo);
+    glState.bindFramebuffer(depth_map_fbo);
     // Attach the depth map texture to the depth map framebuffer
     //glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depth_map_texture, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_map_texture, 0);
@@ -647,10 +815,14 @@ int main(int argc, char *argv[]) {
     
     // Shader config
     
-    GLuint textureMapLocation = glGetUniformLocation(shaderScene, "textureSampler");
-    glUniform1i(textureMapLocation, 0);
-    GLuint shadowMapLocation = glGetUniformLocation(shaderScene, "shadow_map");
-    glUniform1i(shadowMapLocation, 1);
+    shaderScene.setInt("textureSampler", 0);
+    shaderScene.setInt("shadow_map", 1);
+    shaderScene.setInt("materialSampler", 2);
+    
+    shaderImpostor.use();
+    shaderImpostor.setInt("impostorSampler", 3);
+    shaderImpostor.setInt("materialColors", 4);
+    shaderScene.use();
     
     // Camera parameters for view transform
     vec3 cameraPosition(0.6f, 10.0f, 0.0f);
@@ -681,38 +853,50 @@ int main(int argc, char *argv[]) {
                              cameraUp);                     // up
     
     // Set projection matrix on both shaders
-    SetUniformMat4(shaderScene, "projection_matrix", projectionMatrix);
+    shaderScene.setMat4("projection_matrix", projectionMatrix);
     
     // Set view matrix on both shaders
-    SetUniformMat4(shaderScene, "view_matrix", viewMatrix);
+    shaderScene.setMat4("view_matrix", viewMatrix);
     
     
     float lightAngleOuter = 25.0;
     float lightAngleInner = 20.0;
     // Set light cutoff angles on scene shader
-    SetUniform1fValue(shaderScene, "light_cutoff_inner", cos(radians(lightAngleInner)));
-    SetUniform1fValue(shaderScene, "light_cutoff_outer", cos(radians(lightAngleOuter)));
+    shaderScene.setFloat("light_cutoff_inner", cos(radians(lightAngleInner)));
+    shaderScene.setFloat("light_cutoff_outer", cos(radians(lightAngleOuter)));
     
     // Set light color on scene shader
-    SetUniformVec3(shaderScene, "light_color", vec3(1.0, 1.0, 1.0));
-    SetUniformVec3(shaderScene, "light_color2", vec3(1.0, 1.0, 1.0)); // Set light color on light shader
+    shaderScene.setVec3("light_color", vec3(1.0, 1.0, 1.0));
+    shaderScene.setVec3("light_color2", vec3(1.0, 1.0, 1.0)); // Set light color on light shader
     
     // Set object color on scene shader
-    SetUniformVec3(shaderScene, "object_color", vec3(1.0, 1.0, 1.0));
+    shaderScene.setVec3("object_color", vec3(1.0, 1.0, 1.0));
     
     GLuint vao = createTexturedCubeVAO();
     GLuint sphereVAO = createSphereObject();
+    enablePartInstancing(vao);
+    enablePartInstancing(sphereVAO);
     GLuint skyboxVAO = createSkyboxObject();
     
     // For frame time
     float lastFrameTime = glfwGetTime();
+    
+    // What the passes culled in the last frame, reported every few seconds
+    const float CULL_REPORT_INTERVAL = 5.0f;
+    CullStats sceneCullStats;
+    CullStats shadowCullStats;
+    float cullReportTimer = 0.0f;
+    
+    // Smoothed car velocity, the chunks ahead of the car are generated before it gets there
+    vec3 lastCarMove = carMove;
+    vec3 carVelocity(0.0f);
     double lastMousePosX, lastMousePosY;
     glfwGetCursorPos(window, &lastMousePosX, &lastMousePosY);
     
     // Other OpenGL states to set once
     glEnable(GL_DEPTH_TEST);
     
-    glBindVertexArray(vao);
+    glState.bindVertexArray(vao);
     
     int previousTstate = GLFW_RELEASE;
     int previousZstate = GLFW_RELEASE;
@@ -726,15 +910,15 @@ int main(int argc, char *argv[]) {
     // Entering Main Loop
     while (!glfwWindowShouldClose(window)) {
         if (skyNum == 1) {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture1);
+            glState.bindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture1);
         } else if (skyNum == 2) {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture2);
+            glState.bindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture2);
         } else if (skyNum == 3) {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture3);
+            glState.bindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture3);
         } else if (skyNum == 4) {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture4);
+            glState.bindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture4);
         } else {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture5);
+            glState.bindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture5);
         }
         
         // Frame time calculation
@@ -745,10 +929,12 @@ int main(int argc, char *argv[]) {
         projectionMatrix = glm::perspective(radians(fov),     // field of view in degrees
                                             800.0f / 600.0f,  // screen aspect ratio
                                             0.5f, 250.0f);    // near and far planes
-        setProjectionMatrix(shaderScene, projectionMatrix);
+        shaderScene.setMat4("projection_matrix", projectionMatrix);
         
         // This matrix is applied to all car parts and the car's headlights (light position, focus & direction)
-        mat4 carTransform = translate(mat4(1.0f), vec3(carMove.x, 1.2f, carMove.z + 5)) *
+        // The car drives over the terrain once it leaves the road
+        mat4 carTransform = translate(mat4(1.0f), vec3(carMove.x, 1.2f + terrainHeight(carMove.x, carMove.z + 5),
+                                                       carMove.z + 5)) *
                             rotate(mat4(1.0f), radians(carAngle), vec3(0.0f, 1.0f, 0.0f));
         
         // Apply the car's translation & rotation to the light position
@@ -760,17 +946,14 @@ int main(int argc, char *argv[]) {
         float lightNearPlane = 0.6f;
         float lightFarPlane = 100.0f;
         
-        mat4 lightProjectionMatrix = frustum(-1.0f, 1.0f, -1.0f, 1.0f, lightNearPlane, lightFarPlane);
+        // The projection is fitted to the visible chunks once they are updated, before the shadow pass
         mat4 lightViewMatrix = lookAt(lightPosition, lightDirection + lightPosition, vec3(0.0f, 1.0f, 0.0f));
-        mat4 lightSpaceMatrix = lightProjectionMatrix * lightViewMatrix;
         
         // Set uniforms for the main headlights
-        SetUniformVec3(shaderScene, "light_position", lightPosition);
-        SetUniformVec3(shaderScene, "light_direction", lightDirection);
-        SetUniformMat4(shaderShadow, "light_view_proj_matrix", lightSpaceMatrix);
-        SetUniformMat4(shaderScene, "light_view_proj_matrix", lightSpaceMatrix);
-        SetUniform1fValue(shaderScene, "light_near_plane", lightNearPlane);
-        SetUniform1fValue(shaderScene, "light_far_plane", lightFarPlane);
+        shaderScene.setVec3("light_position", lightPosition);
+        shaderScene.setVec3("light_direction", lightDirection);
+        shaderScene.setFloat("light_near_plane", lightNearPlane);
+        shaderScene.setFloat("light_far_plane", lightFarPlane);
         
         // Light parameters for point light (light two) (this light amplifies the headlights)
         vec3 lightPosition2 = vec3(1 + carMove.x, -0, 0.0f + carMove.z); // the location of the light in 3D space
@@ -781,66 +964,66 @@ int main(int argc, char *argv[]) {
         float lightFarPlane2 = 15.0f; //180
         
         // Set light far and near planes on scene shader
-        SetUniform1Value(shaderScene, "light_near_plane2", lightNearPlane2);
-        SetUniform1Value(shaderScene, "light_far_plane2", lightFarPlane2);
-        SetUniformVec3(shaderScene, "light_position2", lightPosition2); // Set light position on scene shader
-        SetUniformVec3(shaderScene, "light_direction2", lightDirection2); // Set light direction on scene shader
-        SetUniformVec3(shaderScene, "light_color2", vec3(1.0, 0.8, 0.5)); // Set light color on light shader
+        shaderScene.setFloat("light_near_plane2", lightNearPlane2);
+        shaderScene.setFloat("light_far_plane2", lightFarPlane2);
+        shaderScene.setVec3("light_position2", lightPosition2); // Set light position on scene shader
+        shaderScene.setVec3("light_direction2", lightDirection2); // Set light direction on scene shader
+        shaderScene.setVec3("light_color2", vec3(1.0, 0.8, 0.5)); // Set light color on light shader
         
         // Night and Day Timer
-        SetUniform1fValue(shaderScene, "intensity", intensity); // Set initial intensity
+        shaderScene.setFloat("intensity", intensity); // Set initial intensity
         float skyStrength = 1.0f;
         if (glfwGetTime() <= 5) {
             skyStrength = 0.2f;
-            SetUniform1fValue(shaderScene, "intensity", 0.2);
+            shaderScene.setFloat("intensity", 0.2);
         } else if (glfwGetTime() <= 5.5 || glfwGetTime() >= 21.5) {
             skyStrength = 0.25f;
-            SetUniform1fValue(shaderScene, "intensity", 0.25);
+            shaderScene.setFloat("intensity", 0.25);
         } else if (glfwGetTime() <= 6 || glfwGetTime() >= 21) {
             skyStrength = 0.3f;
-            SetUniform1fValue(shaderScene, "intensity", 0.3);
+            shaderScene.setFloat("intensity", 0.3);
         } else if (glfwGetTime() <= 6.5 || glfwGetTime() >= 20.5) {
             skyStrength = 0.35f;
-            SetUniform1fValue(shaderScene, "intensity", 0.35);
+            shaderScene.setFloat("intensity", 0.35);
         } else if (glfwGetTime() <= 7 || glfwGetTime() >= 20) {
             skyStrength = 0.4f;
-            SetUniform1fValue(shaderScene, "intensity", 0.4);
+            shaderScene.setFloat("intensity", 0.4);
         } else if (glfwGetTime() <= 7.5 || glfwGetTime() >= 19.5) {
             skyStrength = 0.45f;
-            SetUniform1fValue(shaderScene, "intensity", 0.45);
+            shaderScene.setFloat("intensity", 0.45);
         } else if (glfwGetTime() <= 8 || glfwGetTime() >= 19) {
             skyStrength = 0.5f;
-            SetUniform1fValue(shaderScene, "intensity", 0.5);
+            shaderScene.setFloat("intensity", 0.5);
         } else if (glfwGetTime() <= 8.5 || glfwGetTime() >= 18.5) {
             skyStrength = 0.55f;
-            SetUniform1fValue(shaderScene, "intensity", 0.55);
+            shaderScene.setFloat("intensity", 0.55);
         } else if (glfwGetTime() <= 9 || glfwGetTime() >= 18) {
             skyStrength = 0.6f;
-            SetUniform1fValue(shaderScene, "intensity", 0.6);
+            shaderScene.setFloat("intensity", 0.6);
         } else if (glfwGetTime() <= 9.5 || glfwGetTime() >= 17.5) {
             skyStrength = 0.65f;
-            SetUniform1fValue(shaderScene, "intensity", 0.65);
+            shaderScene.setFloat("intensity", 0.65);
         } else if (glfwGetTime() <= 10 || glfwGetTime() >= 17) {
             skyStrength = 0.7f;
-            SetUniform1fValue(shaderScene, "intensity", 0.7);
+            shaderScene.setFloat("intensity", 0.7);
         } else if (glfwGetTime() <= 10.5 || glfwGetTime() >= 16.5) {
             skyStrength = 0.75f;
-            SetUniform1fValue(shaderScene, "intensity", 0.75);
+            shaderScene.setFloat("intensity", 0.75);
         } else if (glfwGetTime() <= 11 || glfwGetTime() >= 16) {
             skyStrength = 0.8f;
-            SetUniform1fValue(shaderScene, "intensity", 0.8);
+            shaderScene.setFloat("intensity", 0.8);
         } else if (glfwGetTime() <= 11.5 || glfwGetTime() >= 15.5) {
             skyStrength = 0.85f;
-            SetUniform1fValue(shaderScene, "intensity", 0.85);
+            shaderScene.setFloat("intensity", 0.85);
         } else if (glfwGetTime() <= 12 || glfwGetTime() >= 15) {
             skyStrength = 0.9f;
-            SetUniform1fValue(shaderScene, "intensity", 0.9);
+            shaderScene.setFloat("intensity", 0.9);
         } else if (glfwGetTime() <= 12.5 || glfwGetTime() >= 14.5) {
             skyStrength = 0.95f;
-            SetUniform1fValue(shaderScene, "intensity", 0.95);
+            shaderScene.setFloat("intensity", 0.95);
         } else {
             skyStrength = 1.0f;
-            SetUniform1fValue(shaderScene, "intensity", 1.0);
+            shaderScene.setFloat("intensity", 1.0);
         }
         
         if (glfwGetTime() >= 25) {
@@ -850,15 +1033,32 @@ int main(int argc, char *argv[]) {
         // Set model matrix and send to both shaders
         mat4 modelMatrix = mat4(1.0f);
         
-        SetUniformMat4(shaderScene, "model_matrix", modelMatrix);
-        SetUniformMat4(shaderShadow, "model_matrix", modelMatrix);
+        shaderScene.setMat4("model_matrix", modelMatrix);
+        shaderShadow.setMat4("model_matrix", modelMatrix);
         
         // Set the view matrix for first person camera and send to both shaders
         viewMatrix = lookAt(cameraPosition, cameraPosition + cameraLookAt, cameraUp);
-        SetUniformMat4(shaderScene, "view_matrix", viewMatrix);
+        shaderScene.setMat4("view_matrix", viewMatrix);
         
         // Set view position on scene shader
-        SetUniformVec3(shaderScene, "view_position", cameraPosition);
+        shaderScene.setVec3("view_position", cameraPosition);
+        
+        // Pick up chunks finished by the workers and queue the missing ones, once for both render passes
+        if (dt > 0.0f) {
+            carVelocity = mix(carVelocity, (carMove - lastCarMove) / dt, 0.1f);
+        }
+        lastCarMove = carMove;
+        updateChunks(cameraPosition, carVelocity);
+        
+        // The shadow map only covers what the camera sees of the headlight's cone, and casters outside of that are
+        // not drawn into it
+        Frustum cameraFrustum(projectionMatrix * viewMatrix);
+        mat4 lightProjectionMatrix = fitShadowProjection(cameraFrustum, cameraPosition, lightViewMatrix,
+                                                         tan(radians(lightAngleOuter)), lightNearPlane, lightFarPlane,
+                                                         DEPTH_MAP_TEXTURE_SIZE);
+        mat4 lightSpaceMatrix = lightProjectionMatrix * lightViewMatrix;
+        shaderShadow.setMat4("light_view_proj_matrix", lightSpaceMatrix);
+        shaderScene.setMat4("light_view_proj_matrix", lightSpaceMatrix);
         
         // Render shadow in 2 passes: 1- Render depth map, 2- Render scene
         // 1- Render shadow map:
@@ -867,40 +1067,42 @@ int main(int argc, char *argv[]) {
         // c- bind depth map framebuffer to output the depth values
         {
             // Use proper shader
-            glUseProgram(shaderShadow);
+            shaderShadow.use();
             // Use proper image output size
-            glViewport(0, 0, DEPTH_MAP_TEXTURE_SIZE, DEPTH_MAP_TEXTURE_SIZE);
+            glState.setViewport(0, 0, DEPTH_MAP_TEXTURE_SIZE, DEPTH_MAP_TEXTURE_SIZE);
             // Bind depth map texture as output framebuffer
-            glBindFramebuffer(GL_FRAMEBUFFER, depth_map_fbo);
+            glState.bindFramebuffer(depth_map_fbo);
             // Clear depth data on the framebuffer
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             
             
-            GLuint worldMatrixLocation = glGetUniformLocation(shaderShadow, "model_matrix");
             
             // Bind geometry
-            glBindVertexArray(vao);
+            glState.bindVertexArray(vao);
             
-            renderScene(shaderShadow, vao, sphereVAO, cameraPosition.z, roadTextureID, dirtTextureID, woodTextureID,
-                        leavesTextureID, carTextureID, tireTextureID, furTextureID, eyeTextureID, carMove,
-                        carTransform);
+            // Culled against the light's frustum, props smaller than a few shadow map texels cast no shadow. A texel
+            // one unit in front of the light is the window's width over the map's size.
+            float texelSize = 2.0f / (lightProjectionMatrix[0][0] * DEPTH_MAP_TEXTURE_SIZE);
+            PassView lightView{Frustum(lightSpaceMatrix), lightPosition, MIN_SHADOW_CASTER_TEXELS * texelSize};
+            shadowCullStats = renderScene<DEPTH_PASS>(shaderShadow, vao, sphereVAO, cameraPosition, lightView,
+                                                      roadTextureID, dirtTextureID, carTransform);
             
             // Unbind geometry
-            glBindVertexArray(0);
+            glState.bindVertexArray(0);
         }
         
         
         //2- Render scene: a- bind the default framebuffer and b- just render like what we do normally
         {
             // Use proper shader
-            glUseProgram(shaderScene);
+            shaderScene.use();
             // Use proper image output size
             // Side note: we get the size from the framebuffer instead of using WIDTH and HEIGHT because of a bug with highDPI displays
             int width, height;
             glfwGetFramebufferSize(window, &width, &height);
-            glViewport(0, 0, width, height);
+            glState.setViewport(0, 0, width, height);
             // Bind screen as output framebuffer
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glState.bindFramebuffer(0);
             // Clear color and depth data on framebuffer
             glClearColor(0.05f, 0.07f, 0.11f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -909,38 +1111,63 @@ int main(int argc, char *argv[]) {
             
             
             // Draw textured geometry
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, depth_map_texture);
+            glState.activeTexture(GL_TEXTURE1);
+            glState.bindTexture(GL_TEXTURE_2D, depth_map_texture);
             
             // Draw textured geometry
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, roadTextureID);
+            glState.activeTexture(GL_TEXTURE0);
+            glState.bindTexture(GL_TEXTURE_2D, roadTextureID);
             // Bind geometry
             
-            GLuint worldMatrixLocation = glGetUniformLocation(shaderScene, "model_matrix");
             // Bind geometry
-            glBindVertexArray(vao);
-            
-            renderScene(shaderScene, vao, sphereVAO, cameraPosition.z, roadTextureID, dirtTextureID, woodTextureID,
-                        leavesTextureID, carTextureID, tireTextureID, furTextureID, eyeTextureID, carMove,
-                        carTransform);
+            glState.bindVertexArray(vao);
+            
+            // Culled against the camera's frustum. The far trees are collected and drawn as impostors after the
+            // scene, shaded with the same ambient light as the scene but without the headlight or shadows.
+            static vector<ImpostorInstance> impostors;
+            impostors.clear();
+            PassView cameraView{cameraFrustum};
+            cameraView.impostors = &impostors;
+            sceneCullStats = renderScene<COLOR_PASS>(shaderScene, vao, sphereVAO, cameraPosition, cameraView,
+                                                     roadTextureID, dirtTextureID, carTransform);
+            
+            shaderImpostor.use();
+            shaderImpostor.setMat4("view_matrix", viewMatrix);
+            shaderImpostor.setMat4("projection_matrix", projectionMatrix);
+            shaderImpostor.setVec3("view_position", cameraPosition);
+            shaderImpostor.setFloat("intensity", skyStrength);
+            shaderImpostor.setInt("useTexture", shaderScene.getInt(textureflag));
+            drawImpostors(shaderImpostor, impostors);
+            shaderScene.use();
             
             // Unbind geometry
-            glBindVertexArray(0);
+            glState.bindVertexArray(0);
+        }
+        
+        cullReportTimer += dt;
+        if (cullReportTimer >= CULL_REPORT_INTERVAL) {
+            cullReportTimer = 0.0f;
+            cout << "Culling: " << sceneCullStats.chunksDrawn << " chunks drawn, " << sceneCullStats.chunksCulled
+                 << " culled; " << sceneCullStats.propsDrawn << " props drawn (" << sceneCullStats.propsSimplified
+                 << " simplified, " << sceneCullStats.propsAsImpostors << " as impostors), "
+                 << sceneCullStats.propsCulled << " culled\n";
+            cout << "Shadow culling: " << shadowCullStats.chunksDrawn << " chunks drawn, "
+                 << shadowCullStats.chunksCulled << " culled; " << shadowCullStats.propsDrawn << " props drawn ("
+                 << shadowCullStats.propsSimplified << " simplified), " << shadowCullStats.propsCulled << " culled\n";
         }
         
         // Draw skybox last for optimization (hidden portions won't be rendered)
-        glUseProgram(shaderSkybox);
-        SetUniformMat4(shaderSkybox, "view", viewMatrix);
-        SetUniformMat4(shaderSkybox, "projection", projectionMatrix);
+        shaderSkybox.use();
+        shaderSkybox.setMat4("view", viewMatrix);
+        shaderSkybox.setMat4("projection", projectionMatrix);
         
         // Apply daytime light changes to sky
-        glUniform1f(glGetUniformLocation(shaderSkybox, "ambientStrength"), skyStrength);
+        shaderSkybox.setFloat("ambientStrength", skyStrength);
         
-        glDepthFunc(GL_LEQUAL); // Change depth function so that the skybox's maximmum depth value gets rendered
-        glBindVertexArray(skyboxVAO);
+        glState.setDepthFunc(GL_LEQUAL); // Change depth function so that the skybox's maximmum depth value gets rendered
+        glState.bindVertexArray(skyboxVAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthFunc(GL_LESS); // Back to default
+        glState.setDepthFunc(GL_LESS); // Back to default
         
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -954,36 +1181,20 @@ int main(int argc, char *argv[]) {
             
             // Toggle texture
             if (previousTstate == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
-                glGetUniformiv(shaderScene, textureflag, currentvalue);
-                if (currentvalue[0] == 1) {
-                    glUseProgram(shaderScene);
-                    glUniform1i(textureflag, 0);
-                } else {
-                    
-                    glUseProgram(shaderScene);
-                    glUniform1i(textureflag, 1);
-                }
+                shaderScene.setInt(textureflag, shaderScene.getInt(textureflag) == 1 ? 0 : 1);
             }
             previousTstate = glfwGetKey(window, GLFW_KEY_T);
             
             // Toggle shadow
             if (previousZstate == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) {
-                glGetUniformiv(shaderScene, shadowflag, currentvalueS);
-                if (currentvalueS[0] == 1) {
-                    glUseProgram(shaderScene);
-                    glUniform1i(shadowflag, 0);
-                } else {
-                    
-                    glUseProgram(shaderScene);
-                    glUniform1i(shadowflag, 1);
-                }
+                shaderScene.setInt(shadowflag, shaderScene.getInt(shadowflag) == 1 ? 0 : 1);
             }
             previousZstate = glfwGetKey(window, GLFW_KEY_Z);
             
             // Toggle lights
             if (previousLstate == GLFW_RELEASE && glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
                 carLight = !carLight; // Toggle headlights on/off
-                SetUniform1Value(shaderScene, "useCarLight", carLight); // Apply headlights toggle
+                shaderScene.setInt("useCarLight", carLight); // Apply headlights toggle
             }
             previousLstate = glfwGetKey(window, GLFW_KEY_L);
             
@@ -1103,10 +1314,11 @@ int main(int argc, char *argv[]) {
             
             glm::normalize(cameraSideVector);
             
-            if (camNum == 1) { cameraPosition = vec3(0.0f + carMove.x, 3.0f, 0.0f + carMove.z); }
-            else if (camNum == 2) { cameraPosition = vec3(0.0f + carMove.x, 3.25f, 5.25f + carMove.z); }
-            else if (camNum == 3) { cameraPosition = vec3(0.0f + carMove.x, 8.0f, 20.0f + carMove.z); }
-            else if (camNum == 4) { cameraPosition = vec3(0.0f + carMove.x, 30.0f, 20.0f + carMove.z); }
+            float carGroundHeight = terrainHeight(carMove.x, carMove.z + 5);
+            if (camNum == 1) { cameraPosition = vec3(0.0f + carMove.x, 3.0f + carGroundHeight, 0.0f + carMove.z); }
+            else if (camNum == 2) { cameraPosition = vec3(0.0f + carMove.x, 3.25f + carGroundHeight, 5.25f + carMove.z); }
+            else if (camNum == 3) { cameraPosition = vec3(0.0f + carMove.x, 8.0f + carGroundHeight, 20.0f + carMove.z); }
+            else if (camNum == 4) { cameraPosition = vec3(0.0f + carMove.x, 30.0f + carGroundHeight, 20.0f + carMove.z); }
             
             
             if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) // move camera to the left
@@ -1145,22 +1357,18 @@ int main(int argc, char *argv[]) {
                 cout << "cameraPos.z: " << cameraPosition.z << "\t Change in time: " << dt << "\n";
             }
             
-            // Driving boundaries
-            if (cameraPosition.x > 2.0f)
-                cameraPosition.x = 2.0f;
-            if (cameraPosition.x < -2.0f)
-                cameraPosition.x = -2.0f;
-            if (carMove.x > 2.0f)
-                carMove.x = 2.0f;
-            if (carMove.x < -2.0f)
-                carMove.x = -2.0f;
-            
             
         }
         
     }
     
+    // No chunk may still be generated once main returns, the statics the workers use are destroyed after it. The chunks'
+    // and the car's GPU buffers have to be deleted while the context still exists.
+    stopChunkWorkers();
+    releaseChunks();
+    releaseCarInstances();
     
+    glState.printStats();
     glfwTerminate();
     
     return 0;
@@ -1211,7 +1419,7 @@ GLuint loadTexture(const char *filename) {
     assert(textureId != 0);
     
     
-    glBindTexture(GL_TEXTURE_2D, textureId);
+    glState.bindTexture(GL_TEXTURE_2D, textureId);
     
     // Step2 Set filter parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -1238,7 +1446,95 @@ GLuint loadTexture(const char *filename) {
     
     // Step5 Free resources
     stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glState.bindTexture(GL_TEXTURE_2D, 0);
+    return textureId;
+}
+
+// Side of every layer of the material texture array, images of other sizes are resampled to it
+const int MATERIAL_LAYER_SIZE = 1024;
+
+// Image of every PartMaterial, and the color its layer is filled with when the image cannot be loaded
+const char *const MATERIAL_TEXTURE_FILES[PART_MATERIAL_COUNT] = {
+        PATH_PREFIX "assets/textures/wood.jpg", PATH_PREFIX "assets/textures/leaves.png",
+        PATH_PREFIX "assets/textures/fur.jpg", PATH_PREFIX "assets/textures/eye.jpg",
+        PATH_PREFIX "assets/textures/car.jpg", PATH_PREFIX "assets/textures/tire.jpg",
+        PATH_PREFIX "assets/textures/road.jpeg"};
+const unsigned char MATERIAL_FALLBACK_COLORS[PART_MATERIAL_COUNT][3] = {
+        {150, 75, 0}, {60, 160, 60}, {140, 100, 70}, {240, 240, 240}, {255, 255, 255}, {50, 50, 50}, {90, 90, 90}};
+
+// Bilinear resampling of an RGBA image to a MATERIAL_LAYER_SIZE square
+void resampleToLayer(const unsigned char *image, int width, int height, unsigned char *layer) {
+    for (int y = 0; y < MATERIAL_LAYER_SIZE; y++) {
+        float sourceY = glm::clamp((y + 0.5f) * height / MATERIAL_LAYER_SIZE - 0.5f, 0.0f, height - 1.0f);
+        int y0 = static_cast<int>(sourceY);
+        int y1 = std::min(y0 + 1, height - 1);
+        float ty = sourceY - y0;
+        for (int x = 0; x < MATERIAL_LAYER_SIZE; x++) {
+            float sourceX = glm::clamp((x + 0.5f) * width / MATERIAL_LAYER_SIZE - 0.5f, 0.0f, width - 1.0f);
+            int x0 = static_cast<int>(sourceX);
+            int x1 = std::min(x0 + 1, width - 1);
+            float tx = sourceX - x0;
+            for (int channel = 0; channel < 4; channel++) {
+                auto texel = [&](int px, int py) { return static_cast<float>(image[(py * width + px) * 4 + channel]); };
+                float value = mix(mix(texel(x0, y0), texel(x1, y0), tx), mix(texel(x0, y1), texel(x1, y1), tx), ty);
+                layer[(y * MATERIAL_LAYER_SIZE + x) * 4 + channel] = static_cast<unsigned char>(value + 0.5f);
+            }
+        }
+    }
+}
+
+// Loads the textures of all prop materials into one GL_TEXTURE_2D_ARRAY, layer i holds PartMaterial i. Parts then
+// only differ in a per-instance layer and all materials are drawn without rebinding textures.
+// Also creates a PART_MATERIAL_COUNT x 1 texture of every material's average color in averageColorTexture
+GLuint loadMaterialTextureArray(GLuint &averageColorTexture) {
+    GLuint textureId = 0;
+    glGenTextures(1, &textureId);
+    assert(textureId != 0);
+    
+    glState.bindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, PART_MATERIAL_COUNT, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    
+    vector<unsigned char> layer(MATERIAL_LAYER_SIZE * MATERIAL_LAYER_SIZE * 4);
+    vector<unsigned char> averageColors(PART_MATERIAL_COUNT * 4);
+    for (uint32_t material = 0; material < PART_MATERIAL_COUNT; material++) {
+        int width, height, nrChannels;
+        unsigned char *data = stbi_load(MATERIAL_TEXTURE_FILES[material], &width, &height, &nrChannels, 4);
+        if (data) {
+            resampleToLayer(data, width, height, layer.data());
+            stbi_image_free(data);
+        } else {
+            std::cerr << "Error::Texture could not load texture file:" << MATERIAL_TEXTURE_FILES[material]
+                      << ", using a plain color" << std::endl;
+            for (size_t i = 0; i < layer.size(); i += 4) {
+                memcpy(&layer[i], MATERIAL_FALLBACK_COLORS[material], 3);
+                layer[i + 3] = 255;
+            }
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(material), MATERIAL_LAYER_SIZE,
+                        MATERIAL_LAYER_SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+        
+        uint64_t sums[3] = {0, 0, 0};
+        for (size_t i = 0; i < layer.size(); i += 4) {
+            for (int channel = 0; channel < 3; channel++) {
+                sums[channel] += layer[i + channel];
+            }
+        }
+        for (int channel = 0; channel < 3; channel++) {
+            averageColors[material * 4 + channel] = static_cast<unsigned char>(sums[channel] / (layer.size() / 4));
+        }
+        averageColors[material * 4 + 3] = 255;
+    }
+    
+    glGenTextures(1, &averageColorTexture);
+    glState.bindTexture(GL_TEXTURE_2D, averageColorTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, PART_MATERIAL_COUNT, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 averageColors.data());
+    
     return textureId;
 }
 
@@ -1246,7 +1542,7 @@ GLuint loadTexture(const char *filename) {
 GLuint loadCubemap(vector<std::string> faces) {
     GLuint textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    glState.bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
     
     int width, height, nrChannels;
     
@@ -1323,7 +1619,7 @@ GLuint createSkyboxObject() {
     GLuint skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    glState.bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -1336,7 +1632,7 @@ GLuint createTexturedCubeVAO() {
     // Create a vertex array
     GLuint vertexArrayObject;
     glGenVertexArrays(1, &vertexArrayObject);
-    glBindVertexArray(vertexArrayObject);
+    glState.bindVertexArray(vertexArrayObject);
     
     // Upload Vertex Buffer to the GPU, keep a reference to it (vertexBufferObject)
     GLuint vertexBufferObject;
@@ -1385,46 +1681,13 @@ GLuint createSphereObject() {
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ebo);
     
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec2> uv;
-    std::vector<glm::vec3> normals;
-    std::vector<unsigned int> indices;
-    std::vector<glm::vec3> colors;
-    
-    const unsigned int X_SEGMENTS = 10;
-    const unsigned int Y_SEGMENTS = 10;
-    const float PI = 3.14159265359;
-    for (unsigned int y = 0; y <= Y_SEGMENTS; ++y) {
-        for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
-            float xSegment = (float) x / (float) X_SEGMENTS;
-            float ySegment = (float) y / (float) Y_SEGMENTS;
-            float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-            float yPos = std::cos(ySegment * PI);
-            float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-            
-            positions.push_back(glm::vec3(xPos, yPos, zPos));
-            colors.push_back(glm::vec3(1.0f, 0.0f, 0.0f));
-            uv.push_back(glm::vec2(xSegment, ySegment));
-            normals.push_back(normalize(vec3(xPos, yPos, zPos)));
-        }
-    }
+    SphereMeshData sphere = buildSphereMesh();
+    const std::vector<glm::vec3> &positions = sphere.positions;
+    const std::vector<glm::vec2> &uv = sphere.uv;
+    const std::vector<glm::vec3> &normals = sphere.normals;
+    const std::vector<unsigned int> &indices = sphere.indices;
+    const std::vector<glm::vec3> &colors = sphere.colors;
     
-    bool oddRow = false;
-    for (unsigned int y = 0; y < Y_SEGMENTS; ++y) {
-        if (!oddRow) // even rows: y == 0, y == 2; and so on
-        {
-            for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
-                indices.push_back(y * (X_SEGMENTS + 1) + x);
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-            }
-        } else {
-            for (int x = X_SEGMENTS; x >= 0; --x) {
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                indices.push_back(y * (X_SEGMENTS + 1) + x);
-            }
-        }
-        oddRow = !oddRow;
-    }
     indexCount = indices.size();
     
     std::vector<float> data;
@@ -1447,7 +1710,7 @@ GLuint createSphereObject() {
             data.push_back(normals[i].z);
         }
     }
-    glBindVertexArray(sphereVAO);
+    glState.bindVertexArray(sphereVAO);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
@@ -1463,357 +1726,481 @@ GLuint createSphereObject() {
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void *) (8 * sizeof(float)));
     
     glBindBuffer(GL_ARRAY_BUFFER, 0); // VAO already stored the state we just defined, safe to unbind buffer
-    glBindVertexArray(0); // Unbind to not modify the VAO
+    glState.bindVertexArray(0); // Unbind to not modify the VAO
     
     return sphereVAO;
 }
 
-// Generates positions for items to be placed on the ground of a world chunk
-class GeneratedItem {
+// GPU copy of a chunk's terrain, all LODs share one vertex buffer and one index buffer.
+// It is only created and destroyed on the render thread, which owns the GL context.
+class TerrainGpuMesh {
 public:
+    TerrainGpuMesh() = default;
+    
+    explicit TerrainGpuMesh(const TerrainMesh &mesh) {
+        glGenVertexArrays(1, &vao);
+        glState.bindVertexArray(vao);
+        
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(TerrainVertex), mesh.vertices.data(),
+                     GL_STATIC_DRAW);
+        
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(),
+                     GL_STATIC_DRAW);
+        
+        // Same attributes as the textured cube: position, normal, uv
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                              (void *) offsetof(TerrainVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void *) offsetof(TerrainVertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void *) offsetof(TerrainVertex, uv));
+        glEnableVertexAttribArray(2);
+        
+        glState.bindVertexArray(0);
+        
+        for (int lod = 0; lod < TERRAIN_LOD_COUNT; lod++) {
+            lodFirstIndex[lod] = mesh.lodFirstIndex[lod];
+            lodIndexCount[lod] = mesh.lodIndexCount[lod];
+        }
+    }
     
-    float x;        // Translation factor on x-axis
-    float z;        // Translation factor on y-axis
-    float itemSize; // Scaling factor for the widest point of the item
-    bool leftSide;  // Whether the item is positioned on left or right side of the road
-    float angle;
-    int colorID;
-    
-    // The constructor generates position x & z for the item based on the arguments
-    // float startPositionZ : The lower z-boundary of the world chunk which the item will be positioned on
-    // float gridSize       : The width of the WorldChunk
-    // float roadWidth      : The width of the road + any additional offset where no objects should be
-    GeneratedItem(float startPositionZ, float itemSize, bool leftSide = false, float gridSize = 100.0f,
-                  float roadWidth = 6.0f) : itemSize(itemSize), leftSide(leftSide) {
-        itemSize += 1.0f; // The 'size' is increased so that there is a bit of empty space between each item
-        
-        float startPositionY = (itemSize / 2.0f) + (leftSide ? -gridSize / 2.0f : roadWidth / 2.0f);
-        float endPositionY = -(itemSize / 2.0f) + (leftSide ? -roadWidth / 2.0f : gridSize / 2.0f);
-        
-        // Generate random positions within the world chunk boundaries
-        random_device dev;
-        default_random_engine generator(dev());
-        
-        uniform_real_distribution<float> xDistribution(startPositionY, endPositionY);
-        uniform_real_distribution<float> zDistribution(startPositionZ + (itemSize / 2.0f),
-                                                       startPositionZ + gridSize - (itemSize / 2.0f));
-        
-        x = xDistribution(generator);
-        z = zDistribution(generator);
-        
-        // Generate random angle
-        uniform_real_distribution<float> angleDistribution(0.0f, 360.0f);
-        angle = angleDistribution(generator);
-        
-        // Generate random colorID (for tree leaves)
-        uniform_int_distribution<int> colorDistribution(0, 6);
-        colorID = colorDistribution(generator);
-    };
+    ~TerrainGpuMesh() {
+        release();
+    }
     
-    GeneratedItem(const GeneratedItem &other) : x(other.x), z(other.z), itemSize(other.itemSize),
-                                                leftSide(other.leftSide), angle(other.angle), colorID(other.colorID) {}
-                                                
-};
-
-class GeneratedTree : GeneratedItem {
-public:
-    mat4 trunk;
-    vector<mat4> leaves;
+    TerrainGpuMesh(TerrainGpuMesh &&other) noexcept {
+        *this = std::move(other);
+    }
     
-    GeneratedTree(float startPositionZ, float itemSize, bool leftSide = false, float gridSize = 100.0f,
-                  float roadWidth = 6.0f) : GeneratedItem(startPositionZ, itemSize, leftSide, gridSize, roadWidth) {}
+    TerrainGpuMesh &operator=(TerrainGpuMesh &&other) noexcept {
+        if (this != &other) {
+            release();
+            vao = other.vao;
+            vbo = other.vbo;
+            ebo = other.ebo;
+            std::copy(other.lodFirstIndex, other.lodFirstIndex + TERRAIN_LOD_COUNT, lodFirstIndex);
+            std::copy(other.lodIndexCount, other.lodIndexCount + TERRAIN_LOD_COUNT, lodIndexCount);
+            other.vao = other.vbo = other.ebo = 0;
+        }
+        return *this;
+    }
     
-    GeneratedTree(const GeneratedItem &other) : GeneratedItem(other) {};
+    // Leaves the terrain's vertex array bound
+    void draw(int lod) const {
+        glState.bindVertexArray(vao);
+        glDrawElements(GL_TRIANGLES, lodIndexCount[lod], GL_UNSIGNED_INT,
+                       (void *) (lodFirstIndex[lod] * sizeof(unsigned int)));
+    }
+
+private:
+    void release() {
+        if (vao != 0) {
+            glState.deleteVertexArray(vao);
+            glDeleteBuffers(1, &vbo);
+            glDeleteBuffers(1, &ebo);
+        }
+    }
     
-    void generateTree() {
-        random_device dev;
-        default_random_engine gen(dev());
-        
-        uniform_real_distribution<float> trunkYDistribution(6.0f, 14.0f);
-        uniform_real_distribution<float> trunkXZDistribution(1.5f, 2.5f);
-        uniform_real_distribution<float> angleDistribution(0.0f, 90.0f);
-        uniform_int_distribution<int> leavesSliceNumDistribution(6, 10); // Range = [start, end)
-        
-        float angle = angleDistribution(gen);
-        float trunkScaleY = trunkYDistribution(gen);
-        float translateY = (trunkScaleY / 2.0f) - 0.3f;
-        int leavesSlicesNum = leavesSliceNumDistribution(gen);
-        
-        trunk = translate(mat4(1.0f), vec3(x, translateY, z)) *
-                rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f)) *
-                scale(mat4(1.0f), vec3(trunkXZDistribution(gen), trunkScaleY, trunkXZDistribution(gen)));
-        
-        float minStart = 4.0f;
-        float maxEnd = itemSize;
-        float maxStep = 2.0f;
-        float minStep = 2.0f;
-        
-        uniform_int_distribution<int> boolDistribution(0, 2); // Range = [start, end)
-        
-        bool goBigger;
-        float lastLeavesXZ = maxEnd;
-        translateY = trunkScaleY;
-        
-        for (int i = 0; i < leavesSlicesNum; i++) {
-            
-            if (lastLeavesXZ + minStep > maxEnd) {
-                goBigger = false;
-            } else if (lastLeavesXZ - minStep < minStart) {
-                goBigger = true;
-            } else {
-                goBigger = boolDistribution(gen);
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    unsigned int lodFirstIndex[TERRAIN_LOD_COUNT] = {};
+    unsigned int lodIndexCount[TERRAIN_LOD_COUNT] = {};
+};
+
+// A generated chunk together with the GPU resources made for it on the render thread, they are freed with the chunk
+// when it is evicted from the cache
+struct ResidentChunk {
+    WorldChunk world;
+    TerrainGpuMesh terrain;
+    StaticMeshRange props;
+    
+    // Level of detail every prop was last drawn with, only used by the render thread while drawing
+    mutable vector<uint8_t> propLODs;
+    
+    explicit ResidentChunk(WorldChunk &&generated)
+            : world(std::move(generated)), terrain(world.terrain), props(world.staticMesh),
+              propLODs(world.staticMesh.props.count(), 0) {
+        // The CPU copies of the meshes are not needed anymore once they are on the GPU, the prop bounds stay for
+        // culling
+        world.terrain = TerrainMesh();
+        world.staticMesh.vertices = vector<StaticVertex>();
+        world.staticMesh.indices = vector<uint32_t>();
+    }
+};
+
+// Chunks within this many rings around the camera's chunk are streamed in and rendered, see setChunkViewRadius()
+int chunkViewRadius = 2;
+
+// Offsets of the visible chunks from the camera's chunk, nearest first
+vector<ChunkCoord> visibleChunkOffsets = chunkSpiral(chunkViewRadius);
+
+// Finished chunks are uploaded to the GPU on the render thread, at most this many per frame so that a burst of
+// finished chunks never stalls a frame. The others wait in the worker pool for the next frames.
+const size_t MAX_CHUNK_UPLOADS_PER_FRAME = 2;
+
+// Time the render thread spends generating chunks per frame when there are no worker threads
+const double CHUNK_GENERATION_BUDGET_SECONDS = 0.004;
+
+// Holds the most recently visited chunks to be able to go back to the same scene. Evicted chunks are generated again
+// from the world seed when they are revisited.
+ChunkCache<ResidentChunk> chunksByPosition(64);
+
+// Optional directory of previously generated chunks, see openChunkStore()
+unique_ptr<ChunkStore> chunkStore;
+
+void openChunkStore(const char *directory) {
+    chunkStore = make_unique<ChunkStore>(directory, WorldChunk::FILE_FORMAT_VERSION);
+}
+
+// Runs on the worker threads: a chunk found in the chunk store is mapped and its sections copied out, otherwise (or
+// when the file is damaged) it is generated and written to the store for the next time. Either way its static mesh is
+// baked here from the parts, off the render thread, it is not stored.
+WorldChunk buildChunk(ChunkCoord chunkID) {
+    if (chunkStore) {
+        MappedChunkFile file;
+        if (chunkStore->load(getWorldSeed(), chunkID, file)) {
+            WorldChunk chunk(chunkID, file);
+            if (chunk.intact) {
+                chunk.bakeStaticMesh();
+                return chunk;
             }
-            
-            uniform_real_distribution<float> leavesXZDistribution =
-                    goBigger ?
-                    uniform_real_distribution<float>(lastLeavesXZ, lastLeavesXZ + maxStep) :
-                    uniform_real_distribution<float>(lastLeavesXZ - maxStep, lastLeavesXZ);
-            
-            
-            float leavesXZ = leavesXZDistribution(gen);
-            
-            angle = angleDistribution(gen);
-            leaves.push_back(translate(mat4(1.0f), vec3(x, translateY, z)) *
-                             rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f)) *
-                             scale(mat4(1.0f), vec3(leavesXZ, 1.0f, leavesXZ)));
-            translateY += 1.0f;
-            
-            lastLeavesXZ = leavesXZ;
         }
     }
     
-};
+    WorldChunk chunk(chunkID);
+    
+    if (chunkStore) {
+        ChunkFileWriter writer;
+        chunk.save(writer);
+        chunkStore->save(getWorldSeed(), chunkID, writer);
+    }
+    chunk.bakeStaticMesh();
+    return chunk;
+}
 
-// A world chunk consists of a ground tile of 100x100, the road and all items (trees, bushes, etc) that are positioned
-// on it. The position information of all items is saved to be able to revisit previously generated chunks.
-class WorldChunk {
-public:
-    enum itemType {
-        RANDOM_TREE, SMALL_TREE, BIG_TREE, BUSH, ROCK, RABBIT, SQUIRREL
-    };
+// Chunks are generated in the background and moved into chunksByPosition by updateChunks(). The pool exists between
+// startChunkWorkers() and stopChunkWorkers().
+unique_ptr<ChunkWorkerPool<WorldChunk>> chunkWorkers;
+unsigned int chunkThreadCount = ChunkWorkerPool<WorldChunk>::defaultThreadCount();
+
+// The cache can never hold less than the visible chunks and the ring around them, so at low speed every chunk
+// prefetched ahead of the car fits next to the visible ones. At higher speeds updateChunks() only prefetches what the
+// cache has room for.
+void setChunkCacheCapacity(size_t capacity) {
+    chunksByPosition.setCapacity(std::max(capacity, chunkSpiral(chunkViewRadius + 1).size()));
+}
+
+void setChunkViewRadius(int radius) {
+    chunkViewRadius = std::max(radius, 1);
+    visibleChunkOffsets = chunkSpiral(chunkViewRadius);
+    setChunkCacheCapacity(chunksByPosition.getCapacity());
+}
+
+ChunkCoord lastChunkID = {0, -100};
+
+void setChunkThreadCount(unsigned int threadCount) {
+    chunkThreadCount = threadCount;
+    if (chunkWorkers) {
+        chunkWorkers->setThreadCount(threadCount);
+    }
+}
+
+void startChunkWorkers() {
+    chunkWorkers = make_unique<ChunkWorkerPool<WorldChunk>>(buildChunk, chunkThreadCount);
+}
+
+// Queued chunks are dropped, the ones being built are finished before this returns
+void stopChunkWorkers() {
+    if (chunkWorkers) {
+        chunkWorkers->stop();
+        chunkWorkers.reset();
+    }
+}
+
+void updateChunks(vec3 cameraPosition, vec3 cameraVelocity) {
+    // Without worker threads the chunks are generated here, within the frame's budget
+    chunkWorkers->pump(CHUNK_GENERATION_BUDGET_SECONDS);
     
-    vector<GeneratedTree> randomTrees;
-    vector<GeneratedItem> randomTreePositions;
-    vector<GeneratedItem> bigTreePositions;
-    vector<GeneratedItem> smallTreePositions;
-    vector<GeneratedItem> rockPositions;
-    vector<GeneratedItem> bushPositions;
-    vector<GeneratedItem> rabbitPositions;
-    vector<GeneratedItem> squirrelPositions;
-    
-    // Num of rows & cols = occupiable width/length of chunk + 1 for potential floating point errors
-    bool occupiedGridsLeft[48][101] = {}; // Fill with false for all rows & cols
-    bool occupiedGridsRight[48][101] = {};// Fill with false for all rows & cols
-    float chunkPositionZ;
-    int chunkPositionID;
-    
-    explicit WorldChunk(int chunkPositionID) : chunkPositionID(chunkPositionID) {
-        chunkPositionZ = static_cast<float>((100 * chunkPositionID) + 50);
-        
-        generateItems(9, 18, 10, 10, 5, 10);
-    };
+    for (auto &finished: chunkWorkers->collectFinished(MAX_CHUNK_UPLOADS_PER_FRAME)) {
+        cout << "POPULATED ID: " << finished.first.x << ", " << finished.first.z << "\n";
+        chunksByPosition.insert(finished.first, ResidentChunk(std::move(finished.second)));
+    }
+    uploadBakedImpostors();
     
-    // If item overlaps an occupied position, it's not inserted and false is returned
-    bool insertItem(GeneratedItem itemPos, itemType item) {
-        vector<GeneratedItem> *positions;
-        
-        switch (item) {
-            case RANDOM_TREE:
-                positions = &randomTreePositions;
-                break;
-            case BUSH:
-                positions = &bushPositions;
-                break;
-            case ROCK:
-                positions = &rockPositions;
-            case BIG_TREE:
-                positions = &bigTreePositions;
-                break;
-            case SMALL_TREE:
-                positions = &smallTreePositions;
-                break;
-            case RABBIT:
-                positions = &rabbitPositions;
-                break;
-            case SQUIRREL:
-                positions = &squirrelPositions;
-            default:
-                break;
-        }
-        
-        bool (&occupiedGrids)[48][101] = itemPos.leftSide ? occupiedGridsLeft : occupiedGridsRight;
-        
-        // Convert item position to range [0, 47] and [0, 100]
-        int x = static_cast<int>(itemPos.x + 50 - (itemPos.itemSize / 2)) + (itemPos.leftSide ? 0 : -53);
-        int z = static_cast<int>(itemPos.z) - (100 * chunkPositionID + 50) - 2;
-        
-        // Check if the generated positions are already occupied
-        for (int i = x; i < static_cast<int>(round(itemPos.itemSize)) + x; i++) {
-            for (int j = z; j < static_cast<int>(round(itemPos.itemSize)) + z; j++) {
-                if (occupiedGrids[i][j]) {
-                    return false;
-                }
-            }
-        }
-        
-        // Mark the new item's positions as occupied
-        for (int i = x; i < static_cast<int>(round(itemPos.itemSize)) + x; i++) {
-            for (int j = z; j < static_cast<int>(round(itemPos.itemSize)) + z; j++) {
-                occupiedGrids[i][j] = true;
-            }
-        }
-        
-        positions->push_back(itemPos);
-        
-        return true;
+    ChunkCoord currentChunkID = WorldChunk::coordAt(cameraPosition.x, cameraPosition.z);
+    
+    if (lastChunkID != currentChunkID) {
+        cout << "CHANGED ID: " << currentChunkID.x << ", " << currentChunkID.z << "\n";
+    }
+    lastChunkID = currentChunkID;
+    
+    // The visible chunks and the ones the car is heading to, by the time it takes to reach them. Only the soonest
+    // needed that fit in the cache are kept, the others would evict each other and be generated again every frame.
+    vector<ChunkNeed> needs = predictChunkNeeds(cameraPosition, cameraVelocity, visibleChunkOffsets);
+    needs.resize(std::min(needs.size(), chunksByPosition.getCapacity()));
+    
+    // Chunks that were queued but are not needed anymore (out of view, or the car turned) are not generated
+    vector<ChunkCoord> needed;
+    needed.reserve(needs.size());
+    for (const auto &need: needs) {
+        needed.push_back(need.chunkID);
+    }
+    sort(needed.begin(), needed.end());
+    chunkWorkers->cancelRequestsIf([&](ChunkCoord chunkID) {
+        return !binary_search(needed.begin(), needed.end(), chunkID);
+    });
+    
+    // Needed chunks are marked as used so they are never the ones evicted. They are touched from the last needed to
+    // the soonest, so the nearest chunks are the most recently used and the prefetched ones are evicted first.
+    for (auto need = needs.rbegin(); need != needs.rend(); ++need) {
+        chunksByPosition.touch(need->chunkID);
     }
     
-    void generateItems(int maxRandTrees, int maxBigTrees, int maxSmallTrees, int maxBushes, int maxRabbits, int maxSquirrels) {
-        
-        // To toggle between left and right sides of the road
-        // Based on the chunk ID so that the side that gets odd num of items (one extra item) is alternated each chunk
-        bool toggleSide = chunkPositionID % 2 == 0;
-        
-        while (maxRandTrees > 0) {
-            toggleSide = !toggleSide;
-            insertItem(GeneratedItem(chunkPositionZ, 8.0f, toggleSide), RANDOM_TREE);
-            --maxRandTrees;
+    // Missing ones are generated again, requested nearest first since the workers take the soonest needed first and
+    // the earliest requested among equals
+    for (const auto &need: needs) {
+        if (chunksByPosition.find(need.chunkID) == nullptr) {
+            chunkWorkers->request(need.chunkID, need.timeToArrival);
         }
-        
-        for (auto tree: randomTreePositions) {
-            GeneratedTree randomTree(tree);
-            randomTree.generateTree();
-            randomTrees.push_back(randomTree);
-        }
-        randomTreePositions.clear();
-        
-        // Big trees on right & left sides (max because if the position generated overlaps another we discard it)
-        while (maxBigTrees > 0) {
-            toggleSide = !toggleSide;
-            insertItem(GeneratedItem(chunkPositionZ, 12.0f, toggleSide), BIG_TREE);
-            --maxBigTrees;
-        }
-        
-        // Small trees on right & left sides
-        while (maxSmallTrees > 0) {
-            toggleSide = !toggleSide;
-            insertItem(GeneratedItem(chunkPositionZ, 5.0f, toggleSide), SMALL_TREE);
-            --maxSmallTrees;
+    }
+}
+
+void releaseChunks() {
+    chunksByPosition.clear();
+    staticGeometry.clear();
+}
+
+// Box around a chunk's terrain and parts. Bare ground and road of a chunk that is not resident yet are a thin box
+// around the ground level.
+void chunkBounds(ChunkCoord chunkID, const ResidentChunk *chunk, vec3 &boundsMin, vec3 &boundsMax) {
+    if (chunk != nullptr) {
+        boundsMin = chunk->world.boundsMin;
+        boundsMax = chunk->world.boundsMax;
+        return;
+    }
+    float chunkPositionX = WorldChunk::positionXForColumn(chunkID.x);
+    float chunkPositionZ = WorldChunk::positionZForID(chunkID.z);
+    boundsMin = vec3(chunkPositionX - 50.0f, -1.0f, chunkPositionZ - 50.0f);
+    boundsMax = vec3(chunkPositionX + 50.0f, 1.0f, chunkPositionZ + 50.0f);
+}
+
+mat4 fitShadowProjection(const Frustum &cameraFrustum, vec3 cameraPosition, const mat4 &lightViewMatrix,
+                         float tanHalfAngle, float nearPlane, float farPlane, unsigned int mapSize) {
+    // Light space window of the chunks the camera sees, in units of x / depth and y / depth
+    vec2 windowMin(INFINITY);
+    vec2 windowMax(-INFINITY);
+    float receiverFar = nearPlane;
+    ChunkCoord currentChunkID = WorldChunk::coordAt(cameraPosition.x, cameraPosition.z);
+    for (const auto &offset: visibleChunkOffsets) {
+        ChunkCoord chunkID{currentChunkID.x + offset.x, currentChunkID.z + offset.z};
+        vec3 boundsMin, boundsMax;
+        chunkBounds(chunkID, chunksByPosition.find(chunkID), boundsMin, boundsMax);
+        if (cameraFrustum.classifyBox(boundsMin, boundsMax) == Frustum::OUTSIDE) {
+            continue;
         }
         
-        // Bushes on right & left sides
-        while (maxBushes > 0) {
-            toggleSide = !toggleSide;
-            insertItem(GeneratedItem(chunkPositionZ, 5.0f, toggleSide), BUSH);
-            --maxBushes;
+        // Box around the chunk's box in light view space, the light looks down -z
+        vec3 viewMin(INFINITY);
+        vec3 viewMax(-INFINITY);
+        for (int corner = 0; corner < 8; corner++) {
+            vec3 point((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y,
+                       (corner & 4) ? boundsMax.z : boundsMin.z);
+            vec3 viewPoint(lightViewMatrix * vec4(point, 1.0f));
+            viewMin = vec3(std::min(viewMin.x, viewPoint.x), std::min(viewMin.y, viewPoint.y),
+                           std::min(viewMin.z, viewPoint.z));
+            viewMax = vec3(std::max(viewMax.x, viewPoint.x), std::max(viewMax.y, viewPoint.y),
+                           std::max(viewMax.z, viewPoint.z));
         }
-        
-        // Rabbits on right & left sides
-        while (maxRabbits > 0) {
-            toggleSide = !toggleSide;
-            insertItem(GeneratedItem(chunkPositionZ, 4.0f, toggleSide), RABBIT);
-            --maxRabbits;
+        float depthNear = std::max(-viewMax.z, nearPlane);
+        float depthFar = std::min(-viewMin.z, farPlane);
+        if (depthNear > depthFar) {
+            continue;
         }
-        
-        // Squirrels on right & left sides
-        while (maxSquirrels > 0) {
-            toggleSide = !toggleSide;
-            insertItem(GeneratedItem(chunkPositionZ, 2.0f, toggleSide), SQUIRREL);
-            --maxSquirrels;
+        receiverFar = std::max(receiverFar, depthFar);
+        
+        // x / depth of a box is extreme at its nearest or farthest depth
+        for (float depth: {depthNear, depthFar}) {
+            windowMin.x = std::min(windowMin.x, std::min(viewMin.x / depth, viewMax.x / depth));
+            windowMin.y = std::min(windowMin.y, std::min(viewMin.y / depth, viewMax.y / depth));
+            windowMax.x = std::max(windowMax.x, std::max(viewMin.x / depth, viewMax.x / depth));
+            windowMax.y = std::max(windowMax.y, std::max(viewMin.y / depth, viewMax.y / depth));
         }
-        
     }
     
-    [[nodiscard]] mat4 getGroundMatrix() const {
-        return translate(mat4(1.0f), vec3(0.0f, -0.3f, chunkPositionZ)) *
-               scale(mat4(1.0f), vec3(100.0f, 0.1f, 100.0f));
+    // Nothing outside the spotlight's cone is lit, its shadows are never looked up
+    windowMin.x = std::max(windowMin.x, -tanHalfAngle);
+    windowMin.y = std::max(windowMin.y, -tanHalfAngle);
+    windowMax.x = std::min(windowMax.x, tanHalfAngle);
+    windowMax.y = std::min(windowMax.y, tanHalfAngle);
+    if (windowMin.x >= windowMax.x || windowMin.y >= windowMax.y) {
+        return frustum(-tanHalfAngle * nearPlane, tanHalfAngle * nearPlane, -tanHalfAngle * nearPlane,
+                       tanHalfAngle * nearPlane, nearPlane, farPlane);
     }
     
-    [[nodiscard]] mat4 getRoadMatrix() const {
-        return translate(mat4(1.0f), vec3(0.0f, -0.1f, chunkPositionZ)) *
-               scale(mat4(1.0f), vec3(10.0f, 0.3f, 100.0f));
+    // The window only takes a few sizes, the whole cone and its halves, and moves in whole texels of its size. Texels
+    // then cover the same part of the world from frame to frame and the shadow edges do not shimmer while the window
+    // follows the camera.
+    float coneWidth = 2.0f * tanHalfAngle;
+    float extent = std::max(windowMax.x - windowMin.x, windowMax.y - windowMin.y) + 2.0f * coneWidth / mapSize;
+    float width = coneWidth;
+    while (width * 0.5f >= extent && width > coneWidth / 8.0f) {
+        width *= 0.5f;
     }
-};
-
-int lastChunkID = -100;
-
-void renderScene(GLuint shader, GLuint texturedCubeVAO, GLuint sphereVAO, float cameraPosZ, GLuint roadTextureID,
-                 GLuint dirtTextureID, GLuint woodTextureID, GLuint leavesTextureID,
-                 GLuint carTextureID, GLuint tireTextureID, GLuint furTextureID, GLuint eyeTextureID, vec3 carMove,
-                 const mat4 &carTransform) {
+    float texel = width / mapSize;
+    float left = floor(windowMin.x / texel) * texel;
+    float bottom = floor(windowMin.y / texel) * texel;
     
+    // The far plane moves in steps too, the depth precision would change every frame otherwise
+    float fittedFar = std::min(ceil(receiverFar / 5.0f) * 5.0f, farPlane);
     
-    int currentChunkID = static_cast<int>(floor((cameraPosZ - 50) / 100));
+    return frustum(left * nearPlane, (left + width) * nearPlane, bottom * nearPlane, (bottom + width) * nearPlane,
+                   nearPlane, fittedFar);
+}
+
+// Adds draw commands for the props of a chunk that the view keeps, each at its level of detail, one command per run of
+// consecutive visible props drawn at the same level. The frustum is only tested when the chunk is partly inside it.
+// Every pass picks the levels by the distance from the camera, so the shadows have the shapes the camera sees.
+void addVisiblePropCommands(const PassView &view, bool testFrustum, vec3 cameraPosition, const ResidentChunk &chunk,
+                            vector<DrawElementsIndirectCommand> &commands, CullStats &stats) {
+    const StaticMeshProps &props = chunk.world.staticMesh.props;
+    size_t count = props.count();
+    static vector<uint8_t> visible;
+    visible.assign(count, 1);
+    if (testFrustum) {
+        view.frustum.cullSpheres(props.centerX.data(), props.centerY.data(), props.centerZ.data(),
+                                 props.radius.data(), count, visible.data());
+    }
+    if (view.minPropSize > 0.0f) {
+        cullSmallSpheres(props.centerX.data(), props.centerY.data(), props.centerZ.data(), props.radius.data(),
+                         count, view.eye, view.minPropSize, visible.data());
+    }
     
-    if (lastChunkID != currentChunkID) {
-        cout << "CHANGED ID: " << currentChunkID << "\n";
+    // Props out of view keep their level until they are seen again. A tree stays at its coarsest mesh until its
+    // impostor is on the GPU.
+    vector<uint8_t> &levels = chunk.propLODs;
+    for (size_t i = 0; i < count; i++) {
+        if (visible[i]) {
+            float distance = length(vec3(props.centerX[i], props.centerY[i], props.centerZ[i]) - cameraPosition);
+            int level = selectPropLOD(props.type[i], distance, levels[i]);
+            const PropLODs &lods = PROP_LODS[props.type[i]];
+            if (lods.impostor && level == lods.levels - 1 && !impostorReady(chunk.world, i)) {
+                level--;
+            }
+            levels[i] = static_cast<uint8_t>(level);
+        }
     }
-    lastChunkID = currentChunkID;
     
-    // Only 5 chunks in total are rendered each frame (number of chunks needs to be odd for proper positioning)
-    for (int i = currentChunkID - 2; i <= currentChunkID + 2; i++) {
-        // All previously rendered chunks are saved to be able to go back to same scene
-        if (!chunksByPosition.count(i)) {
-            cout << "POPULATED ID: " << i << "\n";
-            chunksByPosition.insert(make_pair(i, WorldChunk(i)));
+    uint32_t visibleCount = 0;
+    size_t runStart = 0;
+    for (size_t i = 0; i <= count; i++) {
+        bool drawn = i < count && visible[i];
+        if (drawn) {
+            visibleCount++;
+            stats.propsSimplified += levels[i] > 0 ? 1 : 0;
+            const PropLODs &lods = PROP_LODS[props.type[i]];
+            if (lods.impostor && levels[i] == lods.levels - 1 && view.impostors != nullptr) {
+                const TreeImpostor &impostor = chunk.world.impostors[chunk.world.propImpostors[i]];
+                auto layer = static_cast<float>(impostor.archetype);
+                view.impostors->push_back(ImpostorInstance{vec4(impostor.center, impostor.radius),
+                                                           vec4(impostor.color, layer)});
+                stats.propsAsImpostors++;
+            }
+            if (i == runStart || levels[i] == levels[runStart]) {
+                continue;
+            }
         }
-        
-        WorldChunk chunk = chunksByPosition.at(i);
-        
-        // Floor
-        glBindTexture(GL_TEXTURE_2D, dirtTextureID);
-        worldMatrix = chunk.getGroundMatrix();
-        setWorldMatrix(shader, worldMatrix);
-        SetUniformVec3(shader, "object_color", vec3(0.38f, 0.63f, 0.33f)); // Green
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        
-        // Road
-        glBindTexture(GL_TEXTURE_2D, roadTextureID);
-        worldMatrix = chunk.getRoadMatrix();
-        setWorldMatrix(shader, worldMatrix);
-        SetUniformVec3(shader, "object_color", vec3(0.5f, 0.5f, 0.5f)); // Gray
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        
-        for (auto tree: chunk.bigTreePositions) {
-            drawTree(shader, tree.z, tree.x, 0.0f, 1, woodTextureID, leavesTextureID, tree.colorID);
+        if (i > runStart) {
+            const vector<uint32_t> &firstIndex = props.firstIndex[levels[runStart]];
+            if (firstIndex[i] > firstIndex[runStart]) {
+                commands.push_back(chunk.props.drawCommand(firstIndex[runStart], firstIndex[i] - firstIndex[runStart]));
+            }
         }
-        
-        for (auto tree: chunk.smallTreePositions) {
-            drawTree(shader, tree.z, tree.x, 0.0f, 2, woodTextureID, leavesTextureID, tree.colorID);
+        runStart = drawn ? i : i + 1;
+    }
+    stats.propsDrawn += visibleCount;
+    stats.propsCulled += static_cast<uint32_t>(count) - visibleCount;
+}
+
+// Draws the chunks around the camera, their props and the car. Chunks outside the frustum are skipped, and so are the
+// props outside of it in chunks that are only partly inside. The depth pass only sets transforms, no textures or
+// colors.
+template<RenderPass pass>
+CullStats renderScene(ShaderProgram &shader, GLuint texturedCubeVAO, GLuint sphereVAO, vec3 cameraPosition,
+                      const PassView &view, GLuint roadTextureID, GLuint dirtTextureID, const mat4 &carTransform) {
+    CullStats stats;
+    
+    // Set once per chunk, looked up once per pass
+    ShaderProgram::Uniform modelMatrix = shader.uniform("model_matrix");
+    ShaderProgram::Uniform objectColor = pass == COLOR_PASS ? shader.uniform("object_color") : -1;
+    
+    ChunkCoord currentChunkID = WorldChunk::coordAt(cameraPosition.x, cameraPosition.z);
+    
+    const GLuint meshVAOs[PART_MESH_COUNT] = {texturedCubeVAO, sphereVAO};
+    static vector<DrawElementsIndirectCommand> staticMeshCommands;
+    staticMeshCommands.clear();
+    
+    // Chunks are drawn from the nearest outwards, so the far ones mostly fail the depth test
+    for (const auto &offset: visibleChunkOffsets) {
+        ChunkCoord chunkID{currentChunkID.x + offset.x, currentChunkID.z + offset.z};
+        float chunkPositionX = WorldChunk::positionXForColumn(chunkID.x);
+        float chunkPositionZ = WorldChunk::positionZForID(chunkID.z);
+        
+        // The chunk is read in place, nothing is copied out of the cache
+        const ResidentChunk *chunk = chunksByPosition.find(chunkID);
+        
+        vec3 boundsMin, boundsMax;
+        chunkBounds(chunkID, chunk, boundsMin, boundsMax);
+        uint32_t propCount = chunk != nullptr ? static_cast<uint32_t>(chunk->world.staticMesh.props.count()) : 0;
+        Frustum::Containment containment = view.frustum.classifyBox(boundsMin, boundsMax);
+        if (containment == Frustum::OUTSIDE) {
+            stats.chunksCulled++;
+            stats.propsCulled += propCount;
+            continue;
         }
+        stats.chunksDrawn++;
         
-        for (auto rabbit: chunk.rabbitPositions) {
-            drawRabbit(shader, 0.5f, sphereVAO, rabbit.x, rabbit.z, vec3(1.0f, 1.0f, 1.0f), furTextureID, eyeTextureID, rabbit.angle);
-            glBindVertexArray(texturedCubeVAO);
+        // Floor
+        if constexpr (pass == COLOR_PASS) {
+            glState.bindTexture(GL_TEXTURE_2D, dirtTextureID);
+            shader.setVec3(objectColor, vec3(0.38f, 0.63f, 0.33f)); // Green
         }
-        
-        for (auto squirrel: chunk.squirrelPositions) {
-            drawSquirrel(shader, 0.5f, sphereVAO, squirrel.x, squirrel.z, vec3(0.5f, 0.3f, 0.4f), furTextureID, eyeTextureID, squirrel.angle);
-            glBindVertexArray(texturedCubeVAO);
+        if (chunk != nullptr) {
+            // Terrain vertices are already in world space, farther chunks use coarser LODs
+            worldMatrix = mat4(1.0f);
+            shader.setMat4(modelMatrix, worldMatrix);
+            float distance = length(vec2(chunkPositionX - cameraPosition.x, chunkPositionZ - cameraPosition.z));
+            chunk->terrain.draw(terrainLODForDistance(distance));
+            glState.bindVertexArray(texturedCubeVAO);
+            
+            // The road and the props were merged into one mesh when the chunk was generated, all chunks' meshes are
+            // drawn together after the loop. Only a chunk on the frustum's border needs its props tested against it.
+            addVisiblePropCommands(view, containment != Frustum::INSIDE, cameraPosition, *chunk, staticMeshCommands,
+                                   stats);
+            continue;
         }
         
-        glBindVertexArray(sphereVAO);
-        for (auto bush: chunk.bushPositions) {
-            drawBush(shader, bush.z, bush.x, 0.0f, 1, leavesTextureID);
-        }
+        // A chunk that is still being generated shows as bare ground and road until a worker finishes it
+        worldMatrix = WorldChunk::groundMatrix(chunkPositionX, chunkPositionZ);
+        shader.setMat4(modelMatrix, worldMatrix);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
         
-        glBindVertexArray(texturedCubeVAO);
-        for (auto tree: chunk.randomTrees) {
-            glBindTexture(GL_TEXTURE_2D, woodTextureID);
-            
-            mat4 trunkMatrix = tree.trunk;
-            SetUniformMat4(shader, "model_matrix", trunkMatrix);
-            SetUniformVec3(shader, "object_color", vec3(0.267f, 0.129f, 0.004f)); // Brown
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-            
-            glBindTexture(GL_TEXTURE_2D, leavesTextureID);
-            SetUniformVec3(shader, "object_color", vec3(0.0f, 1.0f, 0.0f)); // Green
-            for (auto leavesSlice: tree.leaves) {
-                SetUniformMat4(shader, "model_matrix", leavesSlice);
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+        if (WorldChunk::hasRoad(chunkID)) {
+            worldMatrix = WorldChunk::roadMatrix(chunkPositionZ);
+            shader.setMat4(modelMatrix, worldMatrix);
+            if constexpr (pass == COLOR_PASS) {
+                glState.bindTexture(GL_TEXTURE_2D, roadTextureID);
+                shader.setVec3(objectColor, vec3(0.5f, 0.5f, 0.5f)); // Gray
             }
+            glDrawArrays(GL_TRIANGLES, 0, 36);
         }
     }
     
-    drawCar(shader, carTransform, sphereVAO, carMove, carTextureID, tireTextureID);
+    drawStaticMeshes(shader, staticMeshCommands);
+    drawCar(shader, carTransform, cameraPosition, meshVAOs);
+    return stats;
 }
\ No newline at end of file
@@ -0,0 +1,352 @@
+#ifndef PROCEDURALWORLD_PART_MESHES_H
+#define PROCEDURALWORLD_PART_MESHES_H
+
+#include "prop_parts.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+// Geometry of the part meshes on the CPU, uploaded by the renderer and merged into the static mesh of every chunk by
+// the worker that generates it. Nothing in here needs a GL context.
+
+struct TexturedColoredVertex {
+    TexturedColoredVertex(vec3 _position, vec3 _normal, vec2 _uv)
+            : position(_position), normal(_normal), uv(_uv) {}
+
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+};
+
+
+// Cube model
+const TexturedColoredVertex texturedCubeVertexArray[] = {  // position, normal, uv
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)), //left
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, 0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(0.0f, 1.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)),
+
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(-1.0f, 0.0f, 0.0f), vec2(1.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(1.0f, 1.0f)), // far
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(0.0f, 0.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(0.0f, 1.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(1.0f, 1.0f)),
+        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(1.0f, 0.0f)),
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, 0.0f, -1.0f), vec2(0.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(1.0f, 1.0f)), // bottom
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(0.0f, 0.0f)),
+        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(1.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(1.0f, 1.0f)),
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, 0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(0.0f, 1.0f)),
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, -0.5f), vec3(0.0f, -1.0f, 0.0f), vec2(0.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(0.0f, 1.0f)), // near 
+        TexturedColoredVertex(vec3(-0.5f, -0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(0.0f, 0.0f)),
+        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(1.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(1.0f, 1.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(0.0f, 1.0f)),
+        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(0.0f, 0.0f, 1.0f), vec2(1.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)), // right 
+        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)),
+        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(1.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, -0.5f, -0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(0.0f, 0.0f)),
+        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(1.0f, 1.0f)),
+        TexturedColoredVertex(vec3(0.5f, -0.5f, 0.5f), vec3(1.0f, 0.0f, 0.0f), vec2(0.0f, 1.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(1.0f, 1.0f)), // top 
+        TexturedColoredVertex(vec3(0.5f, 0.5f, -0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(1.0f, 0.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(0.0f, 0.0f)),
+
+        TexturedColoredVertex(vec3(0.5f, 0.5f, 0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(1.0f, 1.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, -0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(0.0f, 0.0f)),
+        TexturedColoredVertex(vec3(-0.5f, 0.5f, 0.5f), vec3(0.0f, 1.0f, 0.0f), vec2(0.0f, 1.0f))
+};
+
+
+// Unit sphere drawn as one triangle strip. The scene shader reads the second attribute (colors) as the normal, so the
+// spheres are lit with the constant normal (1, 0, 0); the normals are the fourth attribute, which the shader ignores.
+struct SphereMeshData {
+    vector<vec3> positions;
+    vector<vec3> colors;
+    vector<vec2> uv;
+    vector<vec3> normals;
+    vector<unsigned int> indices;
+};
+
+inline SphereMeshData buildSphereMesh() {
+    SphereMeshData sphere;
+
+    const unsigned int X_SEGMENTS = 10;
+    const unsigned int Y_SEGMENTS = 10;
+    const float PI = 3.14159265359;
+    for (unsigned int y = 0; y <= Y_SEGMENTS; ++y) {
+        for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
+            float xSegment = (float) x / (float) X_SEGMENTS;
+            float ySegment = (float) y / (float) Y_SEGMENTS;
+            float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+            float yPos = std::cos(ySegment * PI);
+            float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+
+            sphere.positions.push_back(glm::vec3(xPos, yPos, zPos));
+            sphere.colors.push_back(glm::vec3(1.0f, 0.0f, 0.0f));
+            sphere.uv.push_back(glm::vec2(xSegment, ySegment));
+            sphere.normals.push_back(normalize(vec3(xPos, yPos, zPos)));
+        }
+    }
+
+    bool oddRow = false;
+    for (unsigned int y = 0; y < Y_SEGMENTS; ++y) {
+        if (!oddRow) // even rows: y == 0, y == 2; and so on
+        {
+            for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
+                sphere.indices.push_back(y * (X_SEGMENTS + 1) + x);
+                sphere.indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+            }
+        } else {
+            for (int x = X_SEGMENTS; x >= 0; --x) {
+                sphere.indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+                sphere.indices.push_back(y * (X_SEGMENTS + 1) + x);
+            }
+        }
+        oddRow = !oddRow;
+    }
+
+    return sphere;
+}
+
+// A part mesh as an indexed triangle list in the part's own space, with the normals the scene shader lights it with
+struct PartMeshTriangles {
+    vector<vec3> positions;
+    vector<vec3> normals;
+    vector<vec2> uv;
+    vector<uint32_t> indices;
+};
+
+inline PartMeshTriangles cubeTriangles() {
+    PartMeshTriangles cube;
+    for (const auto &vertex: texturedCubeVertexArray) {
+        // Corners shared by two triangles of a face are stored once
+        uint32_t index = 0;
+        while (index < cube.positions.size() &&
+               (cube.positions[index] != vertex.position || cube.normals[index] != vertex.normal ||
+                cube.uv[index] != vertex.uv)) {
+            index++;
+        }
+        if (index == cube.positions.size()) {
+            cube.positions.push_back(vertex.position);
+            cube.normals.push_back(vertex.normal);
+            cube.uv.push_back(vertex.uv);
+        }
+        cube.indices.push_back(index);
+    }
+    return cube;
+}
+
+inline PartMeshTriangles sphereTriangles() {
+    SphereMeshData sphere = buildSphereMesh();
+    PartMeshTriangles triangles{sphere.positions, sphere.colors, sphere.uv, {}};
+
+    // Every three consecutive strip indices are a triangle, every other one with the opposite winding. The
+    // triangles that repeat a vertex have no area and are left out.
+    for (size_t i = 2; i < sphere.indices.size(); i++) {
+        uint32_t a = sphere.indices[i - 2];
+        uint32_t b = sphere.indices[i - 1];
+        uint32_t c = sphere.indices[i];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        if (i % 2 == 0) {
+            triangles.indices.insert(triangles.indices.end(), {a, b, c});
+        } else {
+            triangles.indices.insert(triangles.indices.end(), {b, a, c});
+        }
+    }
+    return triangles;
+}
+
+inline const PartMeshTriangles &partMeshTriangles(PartMesh mesh) {
+    static const PartMeshTriangles meshes[PART_MESH_COUNT] = {cubeTriangles(), sphereTriangles()};
+    return meshes[mesh];
+}
+
+// Vertex of a chunk's merged static mesh, in world space with the color and material of its part
+struct StaticVertex {
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+    vec3 color;
+    float layer; // Same as PartInstance
+    float tint;
+};
+
+// Bounding sphere of every prop of a static mesh and the indices of each of its levels of detail, as arrays so that
+// the spheres can be culled in one batch, see Frustum::cullSpheres(). Every level lays out the props in the same
+// order, so consecutive props drawn at the same level are one index range.
+struct StaticMeshProps {
+    vector<float> centerX;
+    vector<float> centerY;
+    vector<float> centerZ;
+    vector<float> radius;
+    vector<PropType> type;
+    vector<uint32_t> source;                     // The prop's index in the merged parts, see PartInstance::prop
+    vector<uint32_t> firstIndex[PROP_LOD_COUNT]; // One more than there are props, the last one ends the level
+
+    [[nodiscard]] size_t count() const { return radius.size(); }
+
+    void clear() {
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        radius.clear();
+        type.clear();
+        source.clear();
+        for (auto &level: firstIndex) {
+            level.clear();
+        }
+    }
+};
+
+struct StaticMesh {
+    vector<StaticVertex> vertices;
+    vector<uint32_t> indices;
+    StaticMeshProps props;
+    vec3 boundsMin = vec3(0.0f); // Box around all vertices
+    vec3 boundsMax = vec3(0.0f);
+};
+
+// Interleaves the bits of two 16 bit values (Morton order)
+inline uint32_t mortonCode(uint32_t x, uint32_t z) {
+    auto spread = [](uint32_t v) {
+        v = (v | (v << 8)) & 0x00FF00FFu;
+        v = (v | (v << 4)) & 0x0F0F0F0Fu;
+        v = (v | (v << 2)) & 0x33333333u;
+        v = (v | (v << 1)) & 0x55555555u;
+        return v;
+    };
+    return spread(x & 0xFFFFu) | (spread(z & 0xFFFFu) << 1);
+}
+
+// Merges parts into one triangle list in world space. The positions and normals are transformed the same way the
+// scene shader transforms the instances, so the merged mesh looks exactly like the parts drawn one by one. Every
+// level of detail of the props is merged after the previous one, and within a level the props are laid out in Morton
+// order of their position, so props that are close in the mesh are close in the world and the visible props of a
+// partly visible chunk form few index ranges.
+inline void mergeParts(const vector<PartInstance> &instances, const vector<PartBatch> &batches, StaticMesh &mesh) {
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.props.clear();
+
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    vector<PartMesh> meshOf(instances.size(), PART_CUBE);
+    for (const auto &batch: batches) {
+        vertexCount += batch.count * partMeshTriangles(batch.mesh).positions.size();
+        indexCount += batch.count * partMeshTriangles(batch.mesh).indices.size();
+        fill(meshOf.begin() + batch.first, meshOf.begin() + batch.first + batch.count, batch.mesh);
+    }
+    mesh.vertices.reserve(vertexCount);
+    mesh.indices.reserve(indexCount);
+
+    // The parts of every prop, grouped by prop
+    uint32_t propCount = 0;
+    for (const auto &instance: instances) {
+        propCount = std::max(propCount, instance.prop + 1);
+    }
+    vector<uint32_t> firstPartOf(propCount + 1, 0);
+    for (const auto &instance: instances) {
+        firstPartOf[instance.prop + 1]++;
+    }
+    for (uint32_t prop = 0; prop < propCount; prop++) {
+        firstPartOf[prop + 1] += firstPartOf[prop];
+    }
+    vector<uint32_t> partsByProp(instances.size());
+    vector<uint32_t> nextPart(firstPartOf.begin(), firstPartOf.end() - 1);
+    for (uint32_t i = 0; i < instances.size(); i++) {
+        partsByProp[nextPart[instances[i].prop]++] = i;
+    }
+
+    // Quarter units from the lowest part center are fine enough to order the props of a 100x100 chunk. A prop is
+    // where its first part is.
+    float originX = INFINITY;
+    float originZ = INFINITY;
+    for (const auto &instance: instances) {
+        originX = std::min(originX, instance.model[3].x);
+        originZ = std::min(originZ, instance.model[3].z);
+    }
+    vector<pair<uint32_t, uint32_t>> order;
+    order.reserve(propCount);
+    for (uint32_t prop = 0; prop < propCount; prop++) {
+        if (firstPartOf[prop] == firstPartOf[prop + 1]) {
+            continue;
+        }
+        const PartInstance &first = instances[partsByProp[firstPartOf[prop]]];
+        auto cellX = static_cast<uint32_t>((first.model[3].x - originX) * 4.0f);
+        auto cellZ = static_cast<uint32_t>((first.model[3].z - originZ) * 4.0f);
+        order.emplace_back(mortonCode(cellX, cellZ), prop);
+    }
+    sort(order.begin(), order.end());
+
+    // Box around every level of every prop, in mesh order
+    vector<vec3> propMin(order.size(), vec3(INFINITY));
+    vector<vec3> propMax(order.size(), vec3(-INFINITY));
+    for (int level = 0; level < PROP_LOD_COUNT; level++) {
+        for (size_t p = 0; p < order.size(); p++) {
+            mesh.props.firstIndex[level].push_back(static_cast<uint32_t>(mesh.indices.size()));
+            uint32_t prop = order[p].second;
+            for (uint32_t k = firstPartOf[prop]; k < firstPartOf[prop + 1]; k++) {
+                const PartInstance &instance = instances[partsByProp[k]];
+                const PropLODs &lods = PROP_LODS[instance.propType];
+                if (level >= lods.levels || (instance.lods & (1u << level)) == 0 ||
+                    (lods.impostor && level == lods.levels - 1)) {
+                    continue;
+                }
+
+                const PartMeshTriangles &part = partMeshTriangles(meshOf[partsByProp[k]]);
+                mat3 normalMatrix(instance.model);
+                auto firstVertex = static_cast<uint32_t>(mesh.vertices.size());
+                for (size_t v = 0; v < part.positions.size(); v++) {
+                    vec3 position(instance.model * vec4(part.positions[v], 1.0f));
+                    mesh.vertices.push_back(StaticVertex{position, normalMatrix * part.normals[v], part.uv[v],
+                                                         instance.color, instance.layer, instance.tint});
+                    propMin[p] = glm::min(propMin[p], position);
+                    propMax[p] = glm::max(propMax[p], position);
+                }
+                for (uint32_t index: part.indices) {
+                    mesh.indices.push_back(firstVertex + index);
+                }
+            }
+        }
+        mesh.props.firstIndex[level].push_back(static_cast<uint32_t>(mesh.indices.size()));
+    }
+
+    mesh.boundsMin = vec3(INFINITY);
+    mesh.boundsMax = vec3(-INFINITY);
+    for (size_t p = 0; p < order.size(); p++) {
+        vec3 center = (propMin[p] + propMax[p]) * 0.5f;
+        mesh.props.centerX.push_back(center.x);
+        mesh.props.centerY.push_back(center.y);
+        mesh.props.centerZ.push_back(center.z);
+        mesh.props.radius.push_back(length(propMax[p] - center));
+        mesh.props.type.push_back(instances[partsByProp[firstPartOf[order[p].second]]].propType);
+        mesh.props.source.push_back(order[p].second);
+        mesh.boundsMin = glm::min(mesh.boundsMin, propMin[p]);
+        mesh.boundsMax = glm::max(mesh.boundsMax, propMax[p]);
+    }
+}
+
+#endif //PROCEDURALWORLD_PART_MESHES_H
@@ -0,0 +1,216 @@
+#ifndef PROCEDURALWORLD_POISSON_PLACEMENT_H
+#define PROCEDURALWORLD_POISSON_PLACEMENT_H
+
+#include "world_random.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+// Blue noise placement of round items in a square area (Bridson's Poisson-disk sampling). Items are placed one type at
+// a time with place(). Items of different types never overlap, and items of the same type also keep a minimum
+// spacing between their centers, so they spread evenly instead of clumping. Neighbours are found through a spatial
+// hash, a placement pass is linear in the number of samples it makes.
+class PoissonPlacer {
+public:
+    // Candidates tried around each sample before it is retired (Bridson's k)
+    static constexpr int CANDIDATES_PER_SAMPLE = 12;
+    // Random throws used to start sampling, several so that areas cut off by the excluded band also get samples
+    static constexpr int SEED_THROWS = 16;
+    // Spacing factor of every retry when an area is too crowded
+    static constexpr float SPACING_SHRINK = 0.75f;
+
+    PoissonPlacer(float minX, float minZ, float size, float cellSize = 8.0f)
+            : minX(minX), minZ(minZ), size(size), cellSize(cellSize) {
+        buckets.assign(BUCKET_COUNT, NO_POINT);
+    }
+
+    // No item may reach into the band minX < x < maxX (the road), an empty band excludes nothing
+    void excludeBand(float bandMinX, float bandMaxX) {
+        excludedMinX = bandMinX;
+        excludedMaxX = bandMaxX;
+    }
+
+    // Places up to targetCount items of the given radius, their centers at least spacing apart (spacing is at least
+    // twice the radius). The area is sampled completely with that spacing, then targetCount samples are kept at
+    // random, which keeps the minimum spacing and spreads them over the whole area. Fewer items are only returned
+    // when not even twice the radius leaves room for them.
+    vector<vec2> place(WorldRandom &random, int targetCount, float radius, float spacing) {
+        return place(random, targetCount, radius, spacing, [](float, float) { return 1.0f; });
+    }
+
+    // Same as above, but samples where weightAt(x, z) is higher are more likely to be kept, so items gather where
+    // their density is high. Samples with a weight of 0 are only kept when there are not enough others.
+    template<class Weight>
+    vector<vec2> place(WorldRandom &random, int targetCount, float radius, float spacing, Weight weightAt) {
+        spacing = std::max(spacing, 2.0f * radius);
+        size_t passStart = points.size();
+        vector<uint32_t> active;
+
+        auto tryAdd = [&](float x, float z) {
+            candidateCount++;
+            if (!isFree(x, z, radius, spacing, passStart)) {
+                return false;
+            }
+            active.push_back(static_cast<uint32_t>(points.size()));
+            addPoint(x, z, radius);
+            return true;
+        };
+
+        // When the area is too crowded for targetCount samples the spacing shrinks, down to twice the radius, and
+        // sampling goes on from every sample made so far
+        while (true) {
+            for (int i = 0; i < SEED_THROWS; i++) {
+                tryAdd(random.nextFloat(minX, minX + size), random.nextFloat(minZ, minZ + size));
+            }
+
+            while (!active.empty()) {
+                size_t pick = static_cast<size_t>(random.nextInt(0, static_cast<int>(active.size()) - 1));
+                const Point &center = points[active[pick]];
+                float centerX = center.x;
+                float centerZ = center.z;
+
+                bool added = false;
+                for (int i = 0; i < CANDIDATES_PER_SAMPLE && !added; i++) {
+                    // Uniform in the annulus between spacing and twice the spacing
+                    float angle = random.nextFloat(0.0f, 6.2831853f);
+                    float distance = spacing * std::sqrt(random.nextFloat(1.0f, 4.0f));
+                    added = tryAdd(centerX + distance * std::cos(angle), centerZ + distance * std::sin(angle));
+                }
+                if (!added) {
+                    active[pick] = active.back();
+                    active.pop_back();
+                }
+            }
+
+            if (points.size() - passStart >= static_cast<size_t>(std::max(targetCount, 0)) ||
+                spacing <= 2.0f * radius) {
+                break;
+            }
+            spacing = std::max(spacing * SPACING_SHRINK, 2.0f * radius);
+            for (size_t i = passStart; i < points.size(); i++) {
+                active.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        // Keep a weighted random subset of the samples: every sample gets the key -log(u) / weight and the ones with
+        // the lowest keys are kept (Efraimidis-Spirakis sampling)
+        vector<Point> samples(points.begin() + passStart, points.end());
+        size_t keptCount = std::min(samples.size(), static_cast<size_t>(std::max(targetCount, 0)));
+        if (keptCount < samples.size()) {
+            vector<pair<float, uint32_t>> keys(samples.size());
+            for (size_t i = 0; i < samples.size(); i++) {
+                float weight = std::max(weightAt(samples[i].x, samples[i].z), 1e-6f);
+                float u = random.nextFloat(1e-7f, 1.0f);
+                keys[i] = {-std::log(u) / weight, static_cast<uint32_t>(i)};
+            }
+            nth_element(keys.begin(), keys.begin() + keptCount, keys.end());
+
+            vector<Point> kept(keptCount);
+            for (size_t i = 0; i < keptCount; i++) {
+                kept[i] = samples[keys[i].second];
+            }
+            samples.swap(kept);
+        }
+
+        points.resize(passStart);
+        rebuildBuckets();
+        vector<vec2> placed;
+        placed.reserve(keptCount);
+        for (const auto &sample: samples) {
+            addPoint(sample.x, sample.z, sample.radius);
+            placed.emplace_back(sample.x, sample.z);
+        }
+        return placed;
+    }
+
+    // Candidate positions tested so far, the cost of the placement
+    [[nodiscard]] size_t getCandidateCount() const { return candidateCount; }
+
+private:
+    static constexpr int32_t NO_POINT = -1;
+    static constexpr uint32_t BUCKET_COUNT = 1024; // Power of two
+
+    struct Point {
+        float x;
+        float z;
+        float radius;
+        int32_t next; // Next point in the same bucket
+    };
+
+    [[nodiscard]] int cellOf(float coordinate, float origin) const {
+        return static_cast<int>(std::floor((coordinate - origin) / cellSize));
+    }
+
+    static uint32_t bucketOf(int cellX, int cellZ) {
+        return (static_cast<uint32_t>(cellX) * 0x9E3779B1u ^ static_cast<uint32_t>(cellZ) * 0x85EBCA77u) &
+               (BUCKET_COUNT - 1);
+    }
+
+    void addPoint(float x, float z, float radius) {
+        uint32_t bucket = bucketOf(cellOf(x, minX), cellOf(z, minZ));
+        points.push_back(Point{x, z, radius, buckets[bucket]});
+        buckets[bucket] = static_cast<int32_t>(points.size() - 1);
+        maxRadius = std::max(maxRadius, radius);
+    }
+
+    void rebuildBuckets() {
+        buckets.assign(BUCKET_COUNT, NO_POINT);
+        vector<Point> kept;
+        kept.swap(points);
+        for (const auto &point: kept) {
+            addPoint(point.x, point.z, point.radius);
+        }
+    }
+
+    // Points of the current pass (from passStart) must be spacing away, the others far enough not to overlap
+    [[nodiscard]] bool isFree(float x, float z, float radius, float spacing, size_t passStart) const {
+        if (x - radius < minX || x + radius > minX + size || z - radius < minZ || z + radius > minZ + size) {
+            return false;
+        }
+        if (excludedMaxX > excludedMinX && x + radius > excludedMinX && x - radius < excludedMaxX) {
+            return false;
+        }
+
+        float reach = std::max(spacing, radius + maxRadius);
+        int firstCellX = cellOf(x - reach, minX);
+        int lastCellX = cellOf(x + reach, minX);
+        int firstCellZ = cellOf(z - reach, minZ);
+        int lastCellZ = cellOf(z + reach, minZ);
+
+        for (int cellX = firstCellX; cellX <= lastCellX; cellX++) {
+            for (int cellZ = firstCellZ; cellZ <= lastCellZ; cellZ++) {
+                for (int32_t i = buckets[bucketOf(cellX, cellZ)]; i != NO_POINT; i = points[i].next) {
+                    const Point &point = points[i];
+                    float minDistance = static_cast<size_t>(i) >= passStart ? spacing : radius + point.radius;
+                    float dx = point.x - x;
+                    float dz = point.z - z;
+                    if (dx * dx + dz * dz < minDistance * minDistance) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    float minX;
+    float minZ;
+    float size;
+    float cellSize;
+    float excludedMinX = 0.0f;
+    float excludedMaxX = 0.0f; // Empty band by default
+    float maxRadius = 0.0f;
+
+    vector<Point> points;
+    vector<int32_t> buckets; // First point of every bucket
+    size_t candidateCount = 0;
+};
+
+#endif //PROCEDURALWORLD_POISSON_PLACEMENT_H
@@ -0,0 +1,245 @@
+#ifndef PROCEDURALWORLD_PROP_PARTS_H
+#define PROCEDURALWORLD_PROP_PARTS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+// Props (trees, bushes, animals, the car) are drawn as a list of parts, each part is a cube or a sphere with its own
+// transform and color. Static props never move, so their parts are built once with their final world transform and
+// the render loop only streams them.
+
+enum PartMesh : uint32_t {
+    PART_CUBE, PART_SPHERE, PART_MESH_COUNT
+};
+
+// Which texture a part is drawn with. Every material is one layer of the renderer's material texture array, so parts
+// of all materials are drawn together.
+enum PartMaterial : uint32_t {
+    PART_WOOD, PART_LEAVES, PART_FUR, PART_EYE, PART_CAR, PART_TIRE, PART_ROAD, PART_MATERIAL_COUNT
+};
+
+// Every prop type has up to PROP_LOD_COUNT levels of detail, level 0 is the full prop and every further level a
+// simpler stand-in, drawn from its switch distance on. Going back to a finer level takes coming PROP_LOD_HYSTERESIS
+// (a fraction of the switch distance) closer than that, so props on the border do not flicker between levels.
+enum PropType : uint16_t {
+    PROP_RANDOM_TREE, PROP_BIG_TREE, PROP_SMALL_TREE, PROP_BUSH, PROP_RABBIT, PROP_SQUIRREL, PROP_ROAD, PROP_CAR,
+    PROP_TYPE_COUNT
+};
+
+const int PROP_LOD_COUNT = 3;
+const float PROP_LOD_HYSTERESIS = 0.1f;
+
+struct PropLODs {
+    int levels;
+    float switchDistances[PROP_LOD_COUNT - 1]; // Level i + 1 is drawn from switchDistances[i] on
+    bool impostor;                             // The last level has no parts, an impostor is drawn instead
+};
+
+const PropLODs PROP_LODS[PROP_TYPE_COUNT] = {
+        {3, {90.0f, 150.0f}, true}, // Random tree: trunk and one canopy box, then an impostor
+        {3, {90.0f, 150.0f}, true}, // Big tree: trunk and one canopy box, then an impostor
+        {1, {}, false},             // Small tree, already two boxes
+        {2, {50.0f}, false},        // Bush: a box instead of the sphere
+        {3, {25.0f, 60.0f}, false}, // Rabbit: body and head, then one box
+        {3, {25.0f, 60.0f}, false}, // Squirrel: body, head and tail, then one box
+        {1, {}, false},             // Road
+        {2, {60.0f}, false}};       // Car: body, cabin and boxes for tires
+
+// Level of detail of a prop at a distance from the camera, given the level it was drawn with last
+inline int selectPropLOD(PropType type, float distance, int current) {
+    const PropLODs &lods = PROP_LODS[type];
+    int level = std::min(current, lods.levels - 1);
+    while (level + 1 < lods.levels && distance > lods.switchDistances[level] * (1.0f + PROP_LOD_HYSTERESIS)) {
+        level++;
+    }
+    while (level > 0 && distance < lods.switchDistances[level - 1] * (1.0f - PROP_LOD_HYSTERESIS)) {
+        level--;
+    }
+    return level;
+}
+
+// Levels of detail from first to last, as the bit mask of PartInstance::lods
+inline uint16_t lodRange(int first, int last) {
+    return static_cast<uint16_t>(((1u << (last + 1)) - 1u) & ~((1u << first) - 1u));
+}
+
+const uint16_t LOD_ALL = 0xFFFFu;
+
+struct PartInstance {
+    mat4 model;
+    vec3 color;
+    float layer; // The PartMaterial, as the texture array layer
+    float tint;  // 1 when the color tints the texture, 0 when the texture is drawn as is
+    uint32_t prop;     // Index of the prop the part belongs to, props are numbered in the order they were added
+    PropType propType;
+    uint16_t lods;     // Bit i is set when the part is drawn at level of detail i
+};
+
+// Consecutive instances drawn with the same mesh
+struct PartBatch {
+    PartMesh mesh;
+    uint32_t first;
+    uint32_t count;
+};
+
+// Collects parts in any order and lays them out grouped into batches. Parts belong to the prop last begun.
+class PartListBuilder {
+public:
+    // Returns the new prop's index
+    uint32_t beginProp(PropType type) {
+        prop = propCount++;
+        propType = type;
+        return prop;
+    }
+
+    // lods is the mask of the levels of detail the part is drawn at, see lodRange()
+    void add(PartMesh mesh, PartMaterial material, bool interpolateColor, const mat4 &model, vec3 color,
+             uint16_t lods = LOD_ALL) {
+        float tint = interpolateColor ? 1.0f : 0.0f;
+        buckets[mesh].push_back(PartInstance{model, color, static_cast<float>(material), tint, prop, propType, lods});
+    }
+
+    // Only the parts drawn at level of detail lod, or all of them when lod is negative
+    void build(vector<PartInstance> &instances, vector<PartBatch> &batches, int lod = -1) const {
+        instances.clear();
+        batches.clear();
+        for (uint32_t mesh = 0; mesh < PART_MESH_COUNT; mesh++) {
+            auto first = static_cast<uint32_t>(instances.size());
+            for (const auto &part: buckets[mesh]) {
+                if (lod < 0 || (part.lods & (1u << lod)) != 0) {
+                    instances.push_back(part);
+                }
+            }
+            if (instances.size() > first) {
+                batches.push_back(PartBatch{static_cast<PartMesh>(mesh), first,
+                                            static_cast<uint32_t>(instances.size()) - first});
+            }
+        }
+    }
+
+private:
+    vector<PartInstance> buckets[PART_MESH_COUNT];
+    uint32_t propCount = 0;
+    uint32_t prop = 0;
+    PropType propType = PROP_ROAD;
+};
+
+inline void addBushParts(PartListBuilder &parts, float x, float y, float z, vec3 color = vec3(0.0f, 1.0f, 0.5f)) {
+    mat4 bushMatrix =
+            translate(mat4(1.0f), vec3(x, 1.0f + y, z)) *
+            rotate(mat4(1.0f), radians(90.0f), vec3(0.0f, 1.0f, 0.0f)) * scale(mat4(1.0f), vec3(2.0f, 2.0f, 2.0f));
+    parts.beginProp(PROP_BUSH);
+    parts.add(PART_SPHERE, PART_LEAVES, true, bushMatrix, color, lodRange(0, 0));
+
+    // A cube of about the sphere's volume
+    parts.add(PART_CUBE, PART_LEAVES, true, bushMatrix * scale(mat4(1.0f), vec3(1.6f)), color, lodRange(1, 1));
+}
+
+inline void addSquirrelParts(PartListBuilder &parts, float size, float x, float y, float z, vec3 color, float angle) {
+    float sizeInc = size;
+    mat4 reposition = translate(mat4(1.0f), vec3(x, y, z)) * rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f));//position squirrel in scene
+
+    auto furPart = [&](vec3 offset, vec3 scaling, uint16_t lods) {
+        parts.add(PART_CUBE, PART_FUR, true, reposition * translate(mat4(1.0f), sizeInc * offset) *
+                                             scale(mat4(1.0f), sizeInc * scaling), color, lods);
+    };
+    parts.beginProp(PROP_SQUIRREL);
+    furPart(vec3(0.0f, 1.5f, 0.0f), vec3(1.0f, 2.0f, 0.8f), lodRange(0, 1));    // Body
+    furPart(vec3(-0.5f, 0.7f, 0.3f), vec3(0.4f, 0.3f, 0.5f), lodRange(0, 0));   // Foot
+    furPart(vec3(0.5f, 0.7f, 0.3f), vec3(0.4f, 0.3f, 0.5f), lodRange(0, 0));    // Foot
+    furPart(vec3(0.0f, 2.8f, 0.5f), vec3(0.5f, 0.5f, 0.7f), lodRange(0, 1));    // Head
+    furPart(vec3(0.0f, 2.0f, 0.3f), vec3(0.2f, 2.0f, 0.2f), lodRange(0, 0));    // Neck
+    furPart(vec3(0.0f, 2.0f, 0.0f), vec3(1.5f, 0.3f, 0.3f), lodRange(0, 0));    // Arms
+    furPart(vec3(0.0f, 0.7f, -0.8f), vec3(0.5f, 0.3f, 1.5f), lodRange(0, 1));   // Tail
+    furPart(vec3(0.2f, 3.1f, 0.2f), vec3(0.1f, 0.1f, 0.1f), lodRange(0, 0));    // Ear
+    furPart(vec3(-0.2f, 3.1f, 0.2f), vec3(0.1f, 0.1f, 0.1f), lodRange(0, 0));   // Ear
+    furPart(vec3(0.0f, 1.6f, 0.0f), vec3(1.0f, 2.6f, 1.0f), lodRange(2, 2));    // Whole squirrel
+
+    for (float eyeX: {-0.2f, 0.2f}) {
+        parts.add(PART_SPHERE, PART_EYE, false, reposition * translate(mat4(1.0f), sizeInc * vec3(eyeX, 2.8f, 0.5f)) *
+                                                scale(mat4(1.0f), sizeInc * vec3(0.15f, 0.15f, 0.15f)), vec3(0, 0, 0),
+                  lodRange(0, 0));
+    }
+}
+
+// tree 1 is the big layered tree, tree 2 the small one. Returns the tree's prop.
+inline uint32_t addTreeParts(PartListBuilder &parts, float x, float y, float z, int tree, vec3 leavesColor) {
+    uint32_t prop = 0;
+    if (tree == 1) {
+        mat4 scaleDown = scale(mat4(1.0f), vec3(0.75f));
+        mat4 translateXZ = translate(mat4(1.0f), vec3(x, y, z));
+
+        prop = parts.beginProp(PROP_BIG_TREE);
+
+        //Trunk
+        mat4 trunkMatrix =
+                translate(mat4(1.0f), vec3(0.0f, 5.0f, 0.0f)) * scale(mat4(1.0f), vec3(3.0f, 20.0f, 3.0f));
+        parts.add(PART_CUBE, PART_WOOD, false, translateXZ * scaleDown * trunkMatrix,
+                  vec3(0.267f, 0.129f, 0.004f)); // Brown
+
+        //Leaves, from the widest layer at the bottom to the top
+        const vec4 layers[7] = {vec4(10.0f, 12.0f, 2.0f, 12.0f), vec4(12.0f, 10.0f, 2.0f, 10.0f),
+                                vec4(14.0f, 8.0f, 2.0f, 8.0f), vec4(16.0f, 6.0f, 2.0f, 6.0f),
+                                vec4(18.0f, 4.0f, 2.0f, 4.0f), vec4(20.0f, 2.0f, 2.0f, 2.0f),
+                                vec4(21.5f, 1.0f, 1.0f, 1.0f)}; // Height, then scale
+        for (const vec4 &layer: layers) {
+            mat4 leavesMatrix = translate(mat4(1.0f), vec3(0.0f, layer.x, 0.0f)) *
+                                scale(mat4(1.0f), vec3(layer.y, layer.z, layer.w));
+            parts.add(PART_CUBE, PART_LEAVES, true, translateXZ * scaleDown * leavesMatrix, leavesColor,
+                      lodRange(0, 0));
+        }
+
+        // Far away the layers are one box around their middle
+        mat4 canopyMatrix =
+                translate(mat4(1.0f), vec3(0.0f, 16.75f, 0.0f)) * scale(mat4(1.0f), vec3(7.0f, 11.5f, 7.0f));
+        parts.add(PART_CUBE, PART_LEAVES, true, translateXZ * scaleDown * canopyMatrix, leavesColor, lodRange(1, 1));
+
+    } else if (tree == 2) {
+        prop = parts.beginProp(PROP_SMALL_TREE);
+
+        //Trunk
+        mat4 groundWorldMatrix =
+                translate(mat4(1.0f), vec3(x, 3.0f + y, z)) * scale(mat4(1.0f), vec3(1.0f, 6.0f, 1.0f));
+        parts.add(PART_CUBE, PART_WOOD, false, groundWorldMatrix, vec3(150.0 / 255.0, 75.0 / 255.0, 0.0f));
+
+        //Leaves
+        groundWorldMatrix =
+                translate(mat4(1.0f), vec3(x, 7.5f + y, z)) * scale(mat4(1.0f), vec3(4.0f, 3.0f, 4.0f));
+        parts.add(PART_CUBE, PART_LEAVES, true, groundWorldMatrix, leavesColor);
+    }
+    return prop;
+}
+
+inline void addRabbitParts(PartListBuilder &parts, float size, float x, float y, float z, vec3 color, float angle) {
+    mat4 rotation = rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f));
+
+    float sizeInc = size;
+    mat4 reposition = translate(mat4(1.0f), vec3(x, -0.03f + y, z)) * rotation;//position rabbit in scene
+
+    auto furPart = [&](PartMesh mesh, vec3 offset, vec3 scaling, uint16_t lods) {
+        parts.add(mesh, PART_FUR, false, reposition * translate(mat4(1.0f), sizeInc * offset) *
+                                         scale(mat4(1.0f), sizeInc * scaling), color, lods);
+    };
+    parts.beginProp(PROP_RABBIT);
+    furPart(PART_CUBE, vec3(0.0f, 1.0f, 0.0f), vec3(3.5f, 2.0f, 3.0f), lodRange(0, 1));     // Body
+    furPart(PART_CUBE, vec3(-1.25f, 2.5f, 0.0f), vec3(2.0f, 1.0f, 1.5f), lodRange(0, 1));   // Head
+    furPart(PART_CUBE, vec3(-0.75f, 3.75f, -0.5f), vec3(0.5f, 1.5f, 0.5f), lodRange(0, 0)); // Ear
+    furPart(PART_CUBE, vec3(-0.75f, 3.75f, 0.5f), vec3(0.5f, 1.5f, 0.5f), lodRange(0, 0));  // Ear
+    furPart(PART_SPHERE, vec3(2.0f, 1.0f, 0.0f), vec3(0.5f, 0.5f, 0.5f), lodRange(0, 0));   // Tail
+    furPart(PART_CUBE, vec3(-0.25f, 1.5f, 0.0f), vec3(4.0f, 3.0f, 2.5f), lodRange(2, 2));   // Whole rabbit
+
+    for (float side: {1.0f, -1.0f}) {
+        mat4 eye = translate(mat4(1.0f), sizeInc * vec3(-1.25f, 2.5f, 0.7f * side)) *
+                   rotate(mat4(1.0f), radians(90.0f * side), vec3(0.0f, 1.0f, 0.0f)) *
+                   scale(mat4(1.0f), sizeInc * vec3(0.3f, 0.3f, 0.3f));
+        parts.add(PART_SPHERE, PART_EYE, false, reposition * eye, vec3(0, 0, 0), lodRange(0, 0));
+    }
+}
+
+#endif //PROCEDURALWORLD_PROP_PARTS_H
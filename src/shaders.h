@@ -3,8 +3,13 @@
 
 #define GLEW_STATIC 1   // This allows linking with Static Library on Windows, without DLL
 #include <GL/glew.h>    // Include GLEW - OpenGL Extension Wrangler
+#include "gl_state.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace glm;
 using namespace std;
@@ -17,23 +22,36 @@ inline const char *SCENE_VERT = "#version 330 core\n"
                          "layout (location = 1) in vec3 normals;\n"
                          "layout (location = 2) in vec2 uv;\n"
                          "\n"
+                         "// Per-instance transform, color and material of instanced parts, see drawPartBatches(). Merged static\n"
+                         "// meshes have an identity instance and their color and material per vertex, see StaticGeometry.\n"
+                         "layout (location = 4) in mat4 instance_model_matrix;\n"
+                         "layout (location = 8) in vec3 instance_color;\n"
+                         "layout (location = 9) in vec2 instance_material;\n"
+                         "\n"
                          "uniform mat4 model_matrix;\n"
                          "uniform mat4 view_matrix;\n"
                          "uniform mat4 projection_matrix;\n"
                          "uniform mat4 light_view_proj_matrix;\n"
+                         "uniform vec3 object_color;\n"
+                         "uniform bool useInstancing = false;\n"
                          "\n"
                          "out vec3 fragment_normal;\n"
                          "out vec3 fragment_position;\n"
                          "out vec4 fragment_position_light_space;\n"
                          "out vec2 vertexUV;\n"
+                         "out vec3 fragment_object_color;\n"
+                         "flat out vec2 fragment_material;\n"
                          "\n"
                          "void main()\n"
                          "{\n"
+                         "    mat4 model = useInstancing ? instance_model_matrix : model_matrix;\n"
+                         "    fragment_object_color = useInstancing ? instance_color : object_color;\n"
+                         "    fragment_material = instance_material;\n"
                          "    vertexUV = uv;\n"
-                         "    fragment_normal = mat3(model_matrix) * normals;\n"
-                         "    fragment_position = vec3(model_matrix * vec4(position, 1.0));\n"
+                         "    fragment_normal = mat3(model) * normals;\n"
+                         "    fragment_position = vec3(model * vec4(position, 1.0));\n"
                          "    fragment_position_light_space = light_view_proj_matrix * vec4(fragment_position, 1.0);\n"
-                         "    gl_Position = projection_matrix * view_matrix * model_matrix * vec4(position, 1.0);\n"
+                         "    gl_Position = projection_matrix * view_matrix * model * vec4(position, 1.0);\n"
                          "}";
 
 inline const char *SCENE_FRAG = "#version 330 core\n"
@@ -48,9 +66,10 @@ inline const char *SCENE_FRAG = "#version 330 core\n"
                          "uniform vec3 light_position2;\n"
                          "uniform vec3 light_direction2;\n"
                          "\n"
-                         "uniform vec3 object_color;\n"
                          "uniform sampler2D textureSampler;\n"
+                         "uniform sampler2DArray materialSampler;\n"
                          "uniform bool useTexture = true;\n"
+                         "uniform bool useInstancing = false;\n"
                          "uniform bool useCarLight;\n"
                          "uniform bool interpolateColor = false;"
                          "\n"
@@ -85,6 +104,8 @@ inline const char *SCENE_FRAG = "#version 330 core\n"
                          "in vec4 fragment_position_light_space2;\n"
                          "in vec3 fragment_normal;\n"
                          "in vec2 vertexUV;\n"
+                         "in vec3 fragment_object_color;\n"
+                         "flat in vec2 fragment_material; // Texture array layer and tint of instanced parts\n"
                          "\n"
                          "in vec4 gl_FragCoord;\n"
                          "\n"
@@ -152,13 +173,18 @@ inline const char *SCENE_FRAG = "#version 330 core\n"
                          "    specular = scalar * specular_color(light_color, light_position, light_dir);\n"
                          "    vec3 lightColor = vec3(0.0f);\n"
                          "\n"
+                         "    // Instanced parts read their material's layer of the texture array\n"
+                         "    vec3 textureColor = useInstancing ? texture(materialSampler, vec3(vertexUV, fragment_material.x)).rgb\n"
+                         "                                      : texture(textureSampler, vertexUV).rgb;\n"
+                         "    bool tint = useInstancing ? fragment_material.y > 0.5 : interpolateColor;\n"
+                         "\n"
                          "    vec3 objColor;"
-                         "    if (useTexture && interpolateColor) {"
-                         "        objColor = object_color * texture(textureSampler, vertexUV).rgb;\n"
-                         "    } else if (useTexture && !interpolateColor) {"
-                         "        objColor = texture(textureSampler, vertexUV).rgb;"
+                         "    if (useTexture && tint) {"
+                         "        objColor = fragment_object_color * textureColor;\n"
+                         "    } else if (useTexture && !tint) {"
+                         "        objColor = textureColor;"
                          "    } else {"
-                         "       objColor = object_color;"
+                         "       objColor = fragment_object_color;"
                          "    }"
                          "\n"
                          "    vec3 color;\n"
@@ -213,32 +239,104 @@ inline const char *SKYBOX_FRAG = "#version 330 core\n"
 
 inline const char *SHADOW_VERT = "#version 330 core\n"
                           "layout (location = 0) in vec3 position;\n"
+                          "layout (location = 4) in mat4 instance_model_matrix;\n"
                           "\n"
                           "uniform mat4 light_view_proj_matrix;\n"
                           "uniform mat4 model_matrix;\n"
+                          "uniform bool useInstancing = false;\n"
                           "\n"
                           "void main()\n"
                           "{\n"
+                          "    mat4 model = useInstancing ? instance_model_matrix : model_matrix;\n"
                           "    mat4 scale_bias_matrix = mat4(vec4(0.5, 0.0, 0.0, 0.0),\n"
                           "                                    vec4(0.0, 0.5, 0.0, 0.0),\n"
                           "                                    vec4(0.0, 0.0, 0.5, 0.0),\n"
                           "                                    vec4(0.5, 0.5, 0.5, 1.0));\n"
                           "    gl_Position = \n"
                           "//                    scale_bias_matrix * // bias the depth map coordinates\n"
-                          "                    light_view_proj_matrix * model_matrix * vec4(position, 1.0);\n"
+                          "                    light_view_proj_matrix * model * vec4(position, 1.0);\n"
                           "}";
 
+// Depth only, the shadow map framebuffer has no color attachment. Leaving gl_FragDepth alone keeps early depth tests.
 inline const char *SHADOW_FRAG = "#version 330 core\n"
                           "\n"
-                          "out vec4 FragColor;\n"
+                          "void main()\n"
+                          "{\n"
+                          "}";
+
+// Far trees as camera-facing quads showing the cell of their impostor atlas baked from the direction closest to the
+// camera's, see impostors.h. The hemi-octahedral mapping and the quad's axes match hemiOctahedralEncode() and
+// impostorViewAxes().
+inline const char *IMPOSTOR_VERT = "#version 330 core\n"
+                          "\n"
+                          "const float GRID = 8.0; // IMPOSTOR_GRID\n"
+                          "\n"
+                          "layout (location = 0) in vec2 corner;\n"
+                          "layout (location = 1) in vec4 instance_center_radius;\n"
+                          "layout (location = 2) in vec4 instance_color_layer;\n"
+                          "\n"
+                          "uniform mat4 view_matrix;\n"
+                          "uniform mat4 projection_matrix;\n"
+                          "uniform vec3 view_position;\n"
+                          "\n"
+                          "out vec2 atlas_uv;\n"
+                          "flat out vec4 fragment_color_layer;\n"
                           "\n"
-                          "in vec4 gl_FragCoord;\n"
+                          "vec2 hemi_octahedral_encode(vec3 direction) {\n"
+                          "    direction.y = max(direction.y, 0.0);\n"
+                          "    vec3 d = direction / (abs(direction.x) + direction.y + abs(direction.z) + 1e-6);\n"
+                          "    return vec2(d.x + d.z, d.x - d.z) * 0.5 + 0.5;\n"
+                          "}\n"
                           "\n"
                           "void main()\n"
                           "{\n"
-                          "    gl_FragDepth = gl_FragCoord.z;\n"
+                          "    vec3 center = instance_center_radius.xyz;\n"
+                          "    vec3 direction = normalize(view_position - center);\n"
+                          "    vec3 side = cross(vec3(0.0, 1.0, 0.0), direction);\n"
+                          "    vec3 right = dot(side, side) > 1e-6 ? normalize(side) : vec3(1.0, 0.0, 0.0);\n"
+                          "    vec3 up = cross(direction, right);\n"
                           "\n"
-                          "    FragColor = vec4(vec3(gl_FragCoord.z), 1.0f);\n"
+                          "    vec2 cell = min(floor(hemi_octahedral_encode(direction) * GRID), vec2(GRID - 1.0));\n"
+                          "    atlas_uv = (cell + corner * 0.5 + 0.5) / GRID;\n"
+                          "    fragment_color_layer = instance_color_layer;\n"
+                          "\n"
+                          "    vec3 position = center + (corner.x * right + corner.y * up) * instance_center_radius.w;\n"
+                          "    gl_Position = projection_matrix * view_matrix * vec4(position, 1.0);\n"
+                          "}";
+
+// The atlas holds the material layer, the tint flag and coverage, all premultiplied by coverage for the mipmaps. The
+// materials are shaded with their average color and the scene's ambient light.
+inline const char *IMPOSTOR_FRAG = "#version 330 core\n"
+                          "\n"
+                          "uniform sampler2DArray impostorSampler;\n"
+                          "uniform sampler2D materialColors;\n"
+                          "uniform float intensity;\n"
+                          "uniform bool useTexture = true;\n"
+                          "\n"
+                          "in vec2 atlas_uv;\n"
+                          "flat in vec4 fragment_color_layer;\n"
+                          "\n"
+                          "out vec4 result;\n"
+                          "\n"
+                          "void main()\n"
+                          "{\n"
+                          "    vec4 texel = texture(impostorSampler, vec3(atlas_uv, fragment_color_layer.w));\n"
+                          "    if (texel.a < 0.5) {\n"
+                          "        discard;\n"
+                          "    }\n"
+                          "    int material = int(round(texel.r / texel.a * 255.0));\n"
+                          "    bool tint = texel.g / texel.a > 0.5;\n"
+                          "    vec3 textureColor = texelFetch(materialColors, ivec2(material, 0), 0).rgb;\n"
+                          "\n"
+                          "    vec3 objColor;\n"
+                          "    if (useTexture && tint) {\n"
+                          "        objColor = fragment_color_layer.rgb * textureColor;\n"
+                          "    } else if (useTexture) {\n"
+                          "        objColor = textureColor;\n"
+                          "    } else {\n"
+                          "        objColor = fragment_color_layer.rgb;\n"
+                          "    }\n"
+                          "    result = vec4(intensity * objColor, 1.0);\n"
                           "}";
 
 // Returns shader program ID
@@ -289,47 +387,131 @@ inline int compileAndLinkShaders(const char *vertexShaderSrc, const char *fragme
     return shaderProgram;
 }
 
-// shader variable setters
-inline void SetUniformMat4(GLuint shader_id, const char *uniform_name, mat4 uniform_value) {
-    glUseProgram(shader_id);
-    glUniformMatrix4fv(glGetUniformLocation(shader_id, uniform_name), 1, GL_FALSE, &uniform_value[0][0]);
-}
-
-inline void SetUniformVec3(GLuint shader_id, const char *uniform_name, vec3 uniform_value) {
-    glUseProgram(shader_id);
-    glUniform3fv(glGetUniformLocation(shader_id, uniform_name), 1, value_ptr(uniform_value));
-}
-
-template<class T>
-inline void SetUniform1Value(GLuint shader_id, const char *uniform_name, T uniform_value) {
-    glUseProgram(shader_id);
-    glUniform1i(glGetUniformLocation(shader_id, uniform_name), uniform_value);
-    glUseProgram(0);
-}
-
-template<class T>
-inline void SetUniform1fValue(GLuint shader_id, const char *uniform_name, T uniform_value) {
-    glUseProgram(shader_id);
-    glUniform1f(glGetUniformLocation(shader_id, uniform_name), uniform_value);
-    glUseProgram(0);
-}
-
-inline void setProjectionMatrix(int shaderProgram, mat4 projectionMatrix) {
-    glUseProgram(shaderProgram);
-    GLint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projection_matrix");
-    glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
-}
-
-inline void setViewMatrix(int shaderProgram, mat4 viewMatrix) {
-    glUseProgram(shaderProgram);
-    GLint viewMatrixLocation = glGetUniformLocation(shaderProgram, "view_matrix");
-    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-}
+// A linked shader program with the locations of all its active uniforms looked up once, right after linking. The
+// setters remember the last value of every uniform and skip uploads that would not change it, so setting the same
+// value every frame costs a compare. A program's uniforms must only be set through its ShaderProgram and programs only
+// bound with use(), otherwise the cached values go stale.
+class ShaderProgram {
+public:
+    // Handle of a uniform, see uniform()
+    using Uniform = int;
+    
+    ShaderProgram(const char *vertexShaderSrc, const char *fragmentShaderSrc)
+            : id(static_cast<GLuint>(compileAndLinkShaders(vertexShaderSrc, fragmentShaderSrc))) {
+        resolveUniforms();
+    }
+    
+    ShaderProgram(const ShaderProgram &) = delete;
+    ShaderProgram &operator=(const ShaderProgram &) = delete;
+    
+    [[nodiscard]] GLuint getID() const { return id; }
+    
+    void use() const {
+        glState.useProgram(id);
+    }
+    
+    // Handle for the setters, -1 if the program has no active uniform of that name (setting it does nothing then).
+    // Code that sets a uniform often keeps its handle instead of passing the name every time.
+    [[nodiscard]] Uniform uniform(const char *name) const {
+        auto found = lower_bound(uniforms.begin(), uniforms.end(), name,
+                                 [](const CachedUniform &cached, const char *key) {
+                                     return strcmp(cached.name.c_str(), key) < 0;
+                                 });
+        if (found == uniforms.end() || found->name != name) {
+            return -1;
+        }
+        return static_cast<Uniform>(found - uniforms.begin());
+    }
+    
+    void setMat4(Uniform handle, const mat4 &value) {
+        if (changes(handle, value_ptr(value), sizeof(mat4))) {
+            glUniformMatrix4fv(uniforms[handle].location, 1, GL_FALSE, value_ptr(value));
+        }
+    }
+    
+    void setVec3(Uniform handle, vec3 value) {
+        if (changes(handle, value_ptr(value), sizeof(vec3))) {
+            glUniform3fv(uniforms[handle].location, 1, value_ptr(value));
+        }
+    }
+    
+    void setFloat(Uniform handle, float value) {
+        if (changes(handle, &value, sizeof(float))) {
+            glUniform1f(uniforms[handle].location, value);
+        }
+    }
+    
+    // For int, bool and sampler uniforms
+    void setInt(Uniform handle, GLint value) {
+        if (changes(handle, &value, sizeof(GLint))) {
+            glUniform1i(uniforms[handle].location, value);
+        }
+    }
+    
+    void setMat4(const char *name, const mat4 &value) { setMat4(uniform(name), value); }
+    
+    void setVec3(const char *name, vec3 value) { setVec3(uniform(name), value); }
+    
+    void setFloat(const char *name, float value) { setFloat(uniform(name), value); }
+    
+    void setInt(const char *name, GLint value) { setInt(uniform(name), value); }
+    
+    // Current value of an int, bool or sampler uniform, 0 if there is no such uniform
+    [[nodiscard]] GLint getInt(Uniform handle) const {
+        GLint value = 0;
+        if (handle >= 0) {
+            memcpy(&value, uniforms[handle].value, sizeof(GLint));
+        }
+        return value;
+    }
 
-inline void setWorldMatrix(int shaderProgram, mat4 _worldMatrix) {
-    glUseProgram(shaderProgram);
-    GLint worldMatrixLocation = glGetUniformLocation(shaderProgram, "model_matrix");
-    glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &_worldMatrix[0][0]);
-}
+private:
+    struct CachedUniform {
+        string name;
+        GLint location;
+        unsigned char value[sizeof(mat4)]; // Last value set, starts as the program's initial value
+    };
+    
+    // Reads the name, location and initial value of every active uniform, sorted by name for uniform()
+    void resolveUniforms() {
+        GLint count = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++) {
+            char name[256];
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(id, static_cast<GLuint>(i), sizeof(name), nullptr, &size, &type, name);
+            
+            CachedUniform cached{name, glGetUniformLocation(id, name), {}};
+            if (cached.location < 0) {
+                continue; // Uniform blocks and built-ins
+            }
+            if (type == GL_FLOAT || type == GL_FLOAT_VEC2 || type == GL_FLOAT_VEC3 || type == GL_FLOAT_VEC4 ||
+                type == GL_FLOAT_MAT4) {
+                glGetUniformfv(id, cached.location, reinterpret_cast<GLfloat *>(cached.value));
+            } else if (type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE) {
+                glGetUniformiv(id, cached.location, reinterpret_cast<GLint *>(cached.value));
+            }
+            uniforms.push_back(cached);
+        }
+        
+        sort(uniforms.begin(), uniforms.end(), [](const CachedUniform &a, const CachedUniform &b) {
+            return a.name < b.name;
+        });
+    }
+    
+    // True if the value differs from the cached one, which is then replaced and the program bound for the upload
+    bool changes(Uniform handle, const void *value, size_t size) {
+        if (handle < 0 || memcmp(uniforms[handle].value, value, size) == 0) {
+            return false;
+        }
+        memcpy(uniforms[handle].value, value, size);
+        use();
+        return true;
+    }
+    
+    GLuint id = 0;
+    vector<CachedUniform> uniforms;
+};
 
 #endif //PROCEDURALWORLD_SHADERS_H
@@ -0,0 +1,159 @@
+#ifndef PROCEDURALWORLD_TERRAIN_H
+#define PROCEDURALWORLD_TERRAIN_H
+
+#include "world_random.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+const float TERRAIN_BASE_HEIGHT = -0.25f;  // Top of the flat ground, the road sits on it
+const float TERRAIN_AMPLITUDE = 6.0f;      // Height of the highest hills above the base
+const float TERRAIN_ROAD_CLEARANCE = 8.0f; // The ground stays flat up to this distance from the middle of the road
+const float TERRAIN_ROAD_BLEND = 12.0f;    // Distance over which the hills rise after the flat part
+
+const int TERRAIN_LOD_COUNT = 3;
+const int TERRAIN_RESOLUTION = 32;         // Quads per chunk side at LOD 0, every next LOD halves it
+
+// Same layout as the textured cube vertices so the scene shaders can draw the terrain as is
+struct TerrainVertex {
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+};
+
+// Vertices and indices of every LOD of a chunk's terrain, packed one LOD after the other
+struct TerrainMesh {
+    vector<TerrainVertex> vertices;
+    vector<unsigned int> indices;
+    unsigned int lodFirstIndex[TERRAIN_LOD_COUNT] = {};
+    unsigned int lodIndexCount[TERRAIN_LOD_COUNT] = {};
+};
+
+// Random value in [0, 1] attached to a corner of the noise lattice
+inline float terrainLatticeValue(int x, int z, uint64_t seed) {
+    uint64_t corner = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+    return static_cast<float>(splitMix64(seed ^ splitMix64(corner)) >> 40) * (1.0f / 16777215.0f);
+}
+
+// Smoothly interpolated value noise in [0, 1]
+inline float terrainValueNoise(float x, float z, uint64_t seed) {
+    float cellX = std::floor(x);
+    float cellZ = std::floor(z);
+    int x0 = static_cast<int>(cellX);
+    int z0 = static_cast<int>(cellZ);
+
+    // Quintic fade so that the slopes are continuous between cells
+    float tx = x - cellX;
+    float tz = z - cellZ;
+    tx = tx * tx * tx * (tx * (tx * 6.0f - 15.0f) + 10.0f);
+    tz = tz * tz * tz * (tz * (tz * 6.0f - 15.0f) + 10.0f);
+
+    float near = mix(terrainLatticeValue(x0, z0, seed), terrainLatticeValue(x0 + 1, z0, seed), tx);
+    float far = mix(terrainLatticeValue(x0, z0 + 1, seed), terrainLatticeValue(x0 + 1, z0 + 1, seed), tx);
+    return mix(near, far, tz);
+}
+
+// Height of the terrain above TERRAIN_BASE_HEIGHT at a world position. It only depends on the world seed, so items
+// and neighbouring chunks all agree on it.
+inline float terrainHeight(float x, float z) {
+    uint64_t seed = splitMix64(getWorldSeed() ^ 0x7465727261696eull); // Separate from the item streams
+
+    float height = 0.0f;
+    float amplitude = 0.5f;
+    float frequency = 1.0f / 80.0f;
+    for (int octave = 0; octave < 3; octave++) {
+        height += amplitude * terrainValueNoise(x * frequency, z * frequency, seed + octave);
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+
+    float distanceFromRoad = std::abs(x);
+    float roadFade = glm::clamp((distanceFromRoad - TERRAIN_ROAD_CLEARANCE) / TERRAIN_ROAD_BLEND, 0.0f, 1.0f);
+    roadFade = roadFade * roadFade * (3.0f - 2.0f * roadFade);
+
+    return TERRAIN_AMPLITUDE * height * roadFade;
+}
+
+// Builds all LODs of the terrain covering [minX, minX + size] x [minZ, minZ + size].
+// To keep neighbouring chunks free of cracks whatever LOD each of them uses, the border vertices of every LOD lie on
+// the border of the coarsest LOD: their heights are interpolated between the coarsest border vertices. Two chunks
+// sharing a border then always agree on its shape.
+inline TerrainMesh buildTerrainMesh(float minX, float minZ, float size) {
+    TerrainMesh mesh;
+
+    const int coarsestResolution = TERRAIN_RESOLUTION >> (TERRAIN_LOD_COUNT - 1);
+    const float coarseStep = size / static_cast<float>(coarsestResolution);
+
+    // Height on the border, interpolated along the coarsest border segment containing the position
+    auto borderHeight = [&](float along, float alongMin, bool alongX, float across) {
+        float segment = std::min(std::floor((along - alongMin) / coarseStep), static_cast<float>(coarsestResolution - 1));
+        float start = alongMin + segment * coarseStep;
+        float end = alongMin + (segment + 1.0f) * coarseStep;
+        float t = (along - start) / coarseStep;
+        float startHeight = alongX ? terrainHeight(start, across) : terrainHeight(across, start);
+        float endHeight = alongX ? terrainHeight(end, across) : terrainHeight(across, end);
+        return mix(startHeight, endHeight, t);
+    };
+
+    for (int lod = 0; lod < TERRAIN_LOD_COUNT; lod++) {
+        int resolution = TERRAIN_RESOLUTION >> lod;
+        float step = size / static_cast<float>(resolution);
+        auto firstVertex = static_cast<unsigned int>(mesh.vertices.size());
+
+        for (int j = 0; j <= resolution; j++) {
+            for (int i = 0; i <= resolution; i++) {
+                float x = minX + step * static_cast<float>(i);
+                float z = minZ + step * static_cast<float>(j);
+
+                float height;
+                if (j == 0 || j == resolution) {
+                    height = borderHeight(x, minX, true, z);
+                } else if (i == 0 || i == resolution) {
+                    height = borderHeight(z, minZ, false, x);
+                } else {
+                    height = terrainHeight(x, z);
+                }
+
+                // Normal from the slope of the height function, it is the same on both sides of a border
+                float slopeX = terrainHeight(x + 0.5f, z) - terrainHeight(x - 0.5f, z);
+                float slopeZ = terrainHeight(x, z + 0.5f) - terrainHeight(x, z - 0.5f);
+
+                mesh.vertices.push_back(TerrainVertex{
+                        vec3(x, TERRAIN_BASE_HEIGHT + height, z),
+                        normalize(vec3(-slopeX, 1.0f, -slopeZ)),
+                        vec2(static_cast<float>(i) / resolution, static_cast<float>(j) / resolution) * 10.0f
+                });
+            }
+        }
+
+        mesh.lodFirstIndex[lod] = static_cast<unsigned int>(mesh.indices.size());
+        for (int j = 0; j < resolution; j++) {
+            for (int i = 0; i < resolution; i++) {
+                unsigned int corner = firstVertex + j * (resolution + 1) + i;
+                unsigned int nextRow = corner + resolution + 1;
+                mesh.indices.insert(mesh.indices.end(), {corner, nextRow, corner + 1, corner + 1, nextRow, nextRow + 1});
+            }
+        }
+        mesh.lodIndexCount[lod] = static_cast<unsigned int>(mesh.indices.size()) - mesh.lodFirstIndex[lod];
+    }
+
+    return mesh;
+}
+
+// Finer LODs close to the camera, the distance is measured from the middle of the chunk
+inline int terrainLODForDistance(float distance) {
+    if (distance < 110.0f) {
+        return 0;
+    }
+    if (distance < 210.0f) {
+        return 1;
+    }
+    return TERRAIN_LOD_COUNT - 1;
+}
+
+#endif //PROCEDURALWORLD_TERRAIN_H
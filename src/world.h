@@ -0,0 +1,557 @@
+#ifndef PROCEDURALWORLD_WORLD_H
+#define PROCEDURALWORLD_WORLD_H
+
+// World generation: the items of a chunk and where they are placed. Nothing in here needs a GL context, so chunks can
+// be generated on worker threads and by the headless benchmark.
+
+#include "biome.h"
+#include "chunk_coord.h"
+#include "chunk_store.h"
+#include "impostors.h"
+#include "item_store.h"
+#include "part_meshes.h"
+#include "poisson_placement.h"
+#include "prop_parts.h"
+#include "terrain.h"
+#include "world_random.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace glm;
+using namespace std;
+
+// An item placed on the ground of a world chunk
+class GeneratedItem {
+public:
+    
+    float x;        // Translation factor on x-axis
+    float z;        // Translation factor on y-axis
+    float y = 0.0f; // Height of the terrain under the item
+    float itemSize; // Scaling factor for the widest point of the item
+    bool leftSide;  // Whether the item is positioned on left or right side of the road
+    float angle;
+    int colorID;
+    
+    // The position comes from the chunk's placement (see PoissonPlacer), the rest of the item is random
+    // WorldRandom random   : The item's own random stream, the same stream always gives the same item
+    GeneratedItem(WorldRandom random, float x, float z, float itemSize, bool leftSide = false)
+            : x(x), z(z), itemSize(itemSize), leftSide(leftSide) {
+        
+        // Generate random angle
+        angle = random.nextFloat(0.0f, 360.0f);
+        
+        // Generate random colorID (for tree leaves), one of the 6 leaf colors of the biome
+        colorID = random.nextInt(0, 5);
+    };
+    
+    GeneratedItem(const GeneratedItem &other) : x(other.x), z(other.z), y(other.y), itemSize(other.itemSize),
+                                                leftSide(other.leftSide), angle(other.angle), colorID(other.colorID) {}
+    
+    // Item i of an item store
+    GeneratedItem(const ItemStore &items, size_t i)
+            : x(items.x[i]), z(items.z[i]), y(items.y[i]), itemSize(items.itemSize[i]), leftSide(items.leftSide[i] != 0),
+              angle(items.angle[i]), colorID(items.colorID[i]) {}
+};
+
+class GeneratedTree : GeneratedItem {
+public:
+    mat4 trunk;
+    vector<mat4> leaves;
+    
+    GeneratedTree(WorldRandom random, float x, float z, float itemSize, bool leftSide = false)
+            : GeneratedItem(random, x, z, itemSize, leftSide) {}
+    
+    GeneratedTree(const GeneratedItem &other) : GeneratedItem(other) {};
+    
+    // The random stream decides the shape of the tree, it should be separate from the one used for its position
+    void generateTree(WorldRandom random) {
+        float angle = random.nextFloat(0.0f, 90.0f);
+        float trunkScaleY = random.nextFloat(6.0f, 14.0f);
+        float translateY = (trunkScaleY / 2.0f) - 0.3f;
+        int leavesSlicesNum = random.nextInt(6, 10);
+        
+        float trunkScaleX = random.nextFloat(1.5f, 2.5f);
+        float trunkScaleZ = random.nextFloat(1.5f, 2.5f);
+        trunk = translate(mat4(1.0f), vec3(x, translateY + y, z)) *
+                rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f)) *
+                scale(mat4(1.0f), vec3(trunkScaleX, trunkScaleY, trunkScaleZ));
+        
+        float minStart = 4.0f;
+        float maxEnd = itemSize;
+        float maxStep = 2.0f;
+        float minStep = 2.0f;
+        
+        bool goBigger;
+        float lastLeavesXZ = maxEnd;
+        translateY = trunkScaleY + y;
+        
+        for (int i = 0; i < leavesSlicesNum; i++) {
+            
+            if (lastLeavesXZ + minStep > maxEnd) {
+                goBigger = false;
+            } else if (lastLeavesXZ - minStep < minStart) {
+                goBigger = true;
+            } else {
+                goBigger = random.nextInt(0, 2) != 0; // Growing is twice as likely as shrinking
+            }
+            
+            float leavesXZ = goBigger ?
+                             random.nextFloat(lastLeavesXZ, lastLeavesXZ + maxStep) :
+                             random.nextFloat(lastLeavesXZ - maxStep, lastLeavesXZ);
+            
+            angle = random.nextFloat(0.0f, 90.0f);
+            leaves.push_back(translate(mat4(1.0f), vec3(x, translateY, z)) *
+                             rotate(mat4(1.0f), radians(angle), vec3(0.0f, 1.0f, 0.0f)) *
+                             scale(mat4(1.0f), vec3(leavesXZ, 1.0f, leavesXZ)));
+            translateY += 1.0f;
+            
+            lastLeavesXZ = leavesXZ;
+        }
+    }
+    
+};
+
+// A world chunk consists of a ground tile of 100x100, the road and all items (trees, bushes, etc) that are positioned
+// on it. The position information of all items is saved to be able to revisit previously generated chunks.
+class WorldChunk {
+public:
+    enum itemType {
+        RANDOM_TREE, SMALL_TREE, BIG_TREE, BUSH, ROCK, RABBIT, SQUIRREL, ITEM_TYPE_COUNT
+    };
+    
+    static_assert(ITEM_TYPE_COUNT == BIOME_ITEM_TYPE_COUNT, "Biome tables have one entry per itemType");
+    
+    static constexpr uint32_t TREE_SHAPE_STREAM = 1;
+    static constexpr uint32_t PLACEMENT_STREAM = 2;
+    static constexpr uint32_t BIOME_STREAM = 3;
+    
+    // Widest point of every itemType, rocks are never placed
+    static constexpr float ITEM_SIZES[ITEM_TYPE_COUNT] = {8.0f, 5.0f, 12.0f, 5.0f, 0.0f, 4.0f, 2.0f};
+    
+    // Impostor archetypes: the big tree, then random trees that every random tree picks the closest one of. Their
+    // shapes are the same in every world.
+    static constexpr uint32_t BIG_TREE_ARCHETYPE = 0;
+    static constexpr uint32_t RANDOM_TREE_ARCHETYPE_COUNT = 15;
+    static constexpr uint64_t TREE_ARCHETYPE_SEED = 0x7472656573ull;
+    
+    // Items of one type are spaced so that about twice their target count would fit in the chunk, see placeItems()
+    static constexpr float ITEM_SPREAD = 0.6f;
+    
+    // Version of the chunk file layout written by save(), files of any other version are generated again
+    static constexpr uint32_t FILE_FORMAT_VERSION = 13;
+    
+    // Sections of a chunk file. Every array of every item store has its own section, see itemSection().
+    enum fileSection : uint32_t {
+        PARTS_SECTION = 100, PART_BATCHES_SECTION, TERRAIN_VERTICES_SECTION, TERRAIN_INDICES_SECTION,
+        TERRAIN_LODS_SECTION, IMPOSTORS_SECTION, ITEM_SECTIONS = 1000
+    };
+    
+    // Placed items of every type, indexed by itemType
+    ItemStore items[ITEM_TYPE_COUNT];
+    
+    // Every part of every item with its final transform and color, baked once when the items are generated
+    vector<PartInstance> parts;
+    vector<PartBatch> partBatches;
+    
+    // Impostors of the trees, drawn instead of their parts at their last level of detail
+    vector<TreeImpostor> impostors;
+    
+    // All parts merged into one mesh by bakeStaticMesh(), not saved in chunk files
+    StaticMesh staticMesh;
+    
+    // Impostor of every prop of staticMesh, in the mesh's order. NO_IMPOSTOR for props without one.
+    static constexpr uint32_t NO_IMPOSTOR = ~0u;
+    vector<uint32_t> propImpostors;
+    
+    // False when a loaded chunk file failed validation, the chunk must then be generated again
+    bool intact = true;
+    
+    // Box around the terrain and every part, for culling. Computed by bakeStaticMesh().
+    vec3 boundsMin = vec3(0.0f);
+    vec3 boundsMax = vec3(0.0f);
+    
+    ChunkCoord chunkCoord;
+    float chunkPositionX;
+    float chunkPositionZ;
+    
+    // Heightfield ground of the chunk, every LOD is built here on the worker thread and uploaded by the render thread
+    TerrainMesh terrain;
+    
+    // Every item gets its own random stream, numbered in generation order
+    uint32_t generatedItemCount = 0;
+    
+    // Placement statistics of the generation: items wanted and items that did not fit per itemType, and the candidate
+    // positions tested in total. They are not saved, a loaded chunk has none.
+    uint32_t placementTargets[ITEM_TYPE_COUNT] = {};
+    uint32_t placementShortfalls[ITEM_TYPE_COUNT] = {};
+    uint32_t placementCandidates = 0;
+    
+    // Average weight of every biome over the chunk, not saved either
+    float biomeShares[BIOME_COUNT] = {};
+    
+    explicit WorldChunk(ChunkCoord chunkCoord) : chunkCoord(chunkCoord) {
+        chunkPositionX = positionXForColumn(chunkCoord.x);
+        chunkPositionZ = positionZForID(chunkCoord.z);
+        
+        terrain = buildTerrainMesh(chunkPositionX - 50.0f, chunkPositionZ - 50.0f, 100.0f);
+        generateItems(evaluateChunkBiomes(chunkPositionX - 50.0f, chunkPositionZ, 100.0f));
+    };
+    
+    // Loads a chunk from a mapped chunk file, the sections are copied out as they are. Sections that fail validation
+    // are left empty and clear intact.
+    WorldChunk(ChunkCoord chunkCoord, const MappedChunkFile &file) : chunkCoord(chunkCoord) {
+        chunkPositionX = positionXForColumn(chunkCoord.x);
+        chunkPositionZ = positionZForID(chunkCoord.z);
+        
+        for (int type = 0; type < ITEM_TYPE_COUNT; type++) {
+            items[type].forEachArray([&](uint32_t field, auto &array) {
+                using Element = typename std::decay_t<decltype(array)>::value_type;
+                array = file.sectionVector<Element>(itemSection(type, field));
+            });
+            if (!items[type].hasMatchingArrays()) {
+                items[type].clear();
+                intact = false;
+            }
+        }
+        
+        parts = file.sectionVector<PartInstance>(PARTS_SECTION);
+        partBatches = file.sectionVector<PartBatch>(PART_BATCHES_SECTION);
+        bool partsValid = true;
+        for (const auto &batch: partBatches) {
+            partsValid = partsValid && batch.mesh < PART_MESH_COUNT &&
+                         uint64_t(batch.first) + batch.count <= parts.size();
+        }
+        for (const auto &part: parts) {
+            partsValid = partsValid && part.prop < parts.size() && part.propType < PROP_TYPE_COUNT;
+        }
+        if (!partsValid) {
+            parts.clear();
+            partBatches.clear();
+            intact = false;
+        }
+        
+        impostors = file.sectionVector<TreeImpostor>(IMPOSTORS_SECTION);
+        for (const auto &impostor: impostors) {
+            if (impostor.archetype >= treeImpostors().count() || impostor.prop >= parts.size()) {
+                impostors.clear();
+                intact = false;
+                break;
+            }
+        }
+        
+        terrain.vertices = file.sectionVector<TerrainVertex>(TERRAIN_VERTICES_SECTION);
+        terrain.indices = file.sectionVector<unsigned int>(TERRAIN_INDICES_SECTION);
+        auto lods = file.section<unsigned int>(TERRAIN_LODS_SECTION);
+        bool terrainValid = lods.second == 2 * size_t(TERRAIN_LOD_COUNT);
+        for (int lod = 0; terrainValid && lod < TERRAIN_LOD_COUNT; lod++) {
+            terrain.lodFirstIndex[lod] = lods.first[2 * lod];
+            terrain.lodIndexCount[lod] = lods.first[2 * lod + 1];
+            terrainValid = uint64_t(terrain.lodFirstIndex[lod]) + terrain.lodIndexCount[lod] <= terrain.indices.size();
+        }
+        for (unsigned int index: terrain.indices) {
+            terrainValid = terrainValid && index < terrain.vertices.size();
+        }
+        if (!terrainValid) {
+            terrain = TerrainMesh();
+            intact = false;
+        }
+    }
+    
+    // Writes everything needed to rebuild the chunk without generating it
+    void save(ChunkFileWriter &writer) const {
+        for (int type = 0; type < ITEM_TYPE_COUNT; type++) {
+            items[type].forEachArray([&](uint32_t field, const auto &array) {
+                writer.addSection(itemSection(type, field), array);
+            });
+        }
+        
+        writer.addSection(PARTS_SECTION, parts);
+        writer.addSection(PART_BATCHES_SECTION, partBatches);
+        writer.addSection(IMPOSTORS_SECTION, impostors);
+        
+        writer.addSection(TERRAIN_VERTICES_SECTION, terrain.vertices);
+        writer.addSection(TERRAIN_INDICES_SECTION, terrain.indices);
+        vector<unsigned int> lods;
+        for (int lod = 0; lod < TERRAIN_LOD_COUNT; lod++) {
+            lods.push_back(terrain.lodFirstIndex[lod]);
+            lods.push_back(terrain.lodIndexCount[lod]);
+        }
+        writer.addSection(TERRAIN_LODS_SECTION, lods);
+    }
+    
+    static uint32_t itemSection(int type, uint32_t field) {
+        return ITEM_SECTIONS + static_cast<uint32_t>(type) * ItemStore::FIELD_COUNT + field;
+    }
+    
+    // Random stream of the next item to generate in this chunk
+    WorldRandom nextItemRandom(uint32_t stream = 0) {
+        return WorldRandom(getWorldSeed(), chunkCoord, generatedItemCount++, stream);
+    }
+    
+    // Adds a placed item, its position is already known to be free
+    void insertItem(GeneratedItem itemPos, itemType item) {
+        // The item stands on the terrain
+        itemPos.y = terrainHeight(itemPos.x, itemPos.z);
+        
+        items[item].add(itemPos.x, itemPos.z, itemPos.y, itemPos.itemSize, itemPos.angle, itemPos.leftSide,
+                        itemPos.colorID);
+    }
+    
+    // Places up to targetCount items of one type. Every item keeps one unit of empty space around it, items of the
+    // same type are also kept ITEM_SPREAD * sqrt(area per item) apart so that they spread over the whole chunk.
+    // Within the chunk they are more likely where the biomes want more of them.
+    void placeItems(PoissonPlacer &placer, const ChunkBiomes &biomes, itemType type, int targetCount, float freeArea) {
+        float itemSize = ITEM_SIZES[type];
+        float radius = (itemSize + 1.0f) / 2.0f;
+        float spacing = targetCount > 0 ? ITEM_SPREAD * std::sqrt(freeArea / static_cast<float>(targetCount)) : 0.0f;
+        
+        WorldRandom placementRandom = nextItemRandom(PLACEMENT_STREAM);
+        vector<vec2> positions = placer.place(placementRandom, targetCount, radius, spacing, [&](float x, float z) {
+            return biomes.densityAt(type, x, z);
+        });
+        
+        placementTargets[type] += static_cast<uint32_t>(std::max(targetCount, 0));
+        int missing = targetCount - static_cast<int>(positions.size());
+        placementShortfalls[type] += static_cast<uint32_t>(std::max(missing, 0));
+        
+        items[type].reserve(items[type].count() + positions.size());
+        for (const auto &position: positions) {
+            insertItem(GeneratedItem(nextItemRandom(), position.x, position.y, itemSize, position.x < chunkPositionX),
+                       type);
+        }
+    }
+    
+    // The biomes decide how many items of every type the chunk gets and their colors
+    void generateItems(const ChunkBiomes &biomes) {
+        
+        // Fractional item counts are rounded up or down at random, so on average every chunk gets its exact density
+        WorldRandom biomeRandom = nextItemRandom(BIOME_STREAM);
+        int targetCounts[ITEM_TYPE_COUNT];
+        for (int type = 0; type < ITEM_TYPE_COUNT; type++) {
+            targetCounts[type] = static_cast<int>(biomes.itemsPerChunk(type) + biomeRandom.nextFloat(0.0f, 1.0f));
+        }
+        for (int biome = 0; biome < BIOME_COUNT; biome++) {
+            biomeShares[biome] = biomes.share(biome);
+        }
+        
+        // Items are placed over the 100x100 area starting at the chunk's z, chunks without a road use their whole width
+        float roadWidth = hasRoad(chunkCoord) ? 6.0f : 0.0f;
+        PoissonPlacer placer(chunkPositionX - 50.0f, chunkPositionZ, 100.0f);
+        if (roadWidth > 0.0f) {
+            placer.excludeBand(chunkPositionX - roadWidth / 2.0f, chunkPositionX + roadWidth / 2.0f);
+        }
+        float freeArea = 100.0f * (100.0f - roadWidth);
+        
+        // Largest items first, the smaller ones fill the gaps between them
+        for (itemType type: {BIG_TREE, RANDOM_TREE, SMALL_TREE, BUSH, RABBIT, SQUIRREL}) {
+            placeItems(placer, biomes, type, targetCounts[type], freeArea);
+        }
+        placementCandidates = static_cast<uint32_t>(placer.getCandidateCount());
+        
+        PartListBuilder itemParts;
+        impostors.clear();
+        
+        const ItemStore &randomTrees = items[RANDOM_TREE];
+        for (size_t i = 0; i < randomTrees.count(); i++) {
+            GeneratedTree randomTree(GeneratedItem(randomTrees, i));
+            randomTree.generateTree(nextItemRandom(TREE_SHAPE_STREAM));
+            
+            vec3 leavesColor = biomes.foliageColorAt(randomTrees.x[i], randomTrees.z[i]);
+            uint32_t prop = addRandomTreeParts(itemParts, randomTree, leavesColor);
+            
+            // The impostor is the closest archetype scaled to the tree's height, measured like ImpostorShape does
+            vec3 boundsMin(INFINITY);
+            vec3 boundsMax(-INFINITY);
+            growBoxBounds(randomTree.trunk, boundsMin, boundsMax);
+            for (const auto &leavesSlice: randomTree.leaves) {
+                growBoxBounds(leavesSlice, boundsMin, boundsMax);
+            }
+            float height = boundsMax.y - randomTrees.y[i];
+            float width = std::max(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z);
+            uint32_t archetype = closestRandomTreeArchetype(height, width);
+            addImpostor(vec3(randomTrees.x[i], randomTrees.y[i], randomTrees.z[i]),
+                        height / treeImpostors().shape(archetype).height, leavesColor, archetype, prop);
+        }
+        
+        addItemParts(itemParts, biomes);
+        if (hasRoad(chunkCoord)) {
+            itemParts.beginProp(PROP_ROAD);
+            itemParts.add(PART_CUBE, PART_ROAD, false, getRoadMatrix(), vec3(0.5f, 0.5f, 0.5f));
+        }
+        itemParts.build(parts, partBatches);
+        
+    }
+    
+    // Merges the parts into staticMesh, so the chunk's props draw in one call, computes the chunk's bounds and bakes
+    // the impostor atlases the chunk needs that are not baked yet. Runs on the worker that generated or loaded the
+    // chunk, the render thread only uploads the result.
+    void bakeStaticMesh() {
+        mergeParts(parts, partBatches, staticMesh);
+        
+        vector<uint32_t> impostorOfProp(parts.size(), NO_IMPOSTOR);
+        for (uint32_t i = 0; i < impostors.size(); i++) {
+            impostorOfProp[impostors[i].prop] = i;
+            treeImpostors().bake(impostors[i].archetype);
+        }
+        propImpostors.clear();
+        for (uint32_t prop: staticMesh.props.source) {
+            propImpostors.push_back(impostorOfProp[prop]);
+        }
+        
+        boundsMin = staticMesh.boundsMin;
+        boundsMax = staticMesh.boundsMax;
+        for (const auto &vertex: terrain.vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+    }
+    
+    // Parts of every placed item except the random trees, whose shapes only exist while they are generated. Big trees
+    // also get their impostor.
+    void addItemParts(PartListBuilder &itemParts, const ChunkBiomes &biomes) {
+        const ItemStore &bigTrees = items[BIG_TREE];
+        for (size_t i = 0; i < bigTrees.count(); i++) {
+            vec3 leavesColor = biomes.leafColorAt(bigTrees.x[i], bigTrees.z[i], bigTrees.colorID[i]);
+            uint32_t prop = addTreeParts(itemParts, bigTrees.x[i], bigTrees.y[i], bigTrees.z[i], 1, leavesColor);
+            addImpostor(vec3(bigTrees.x[i], bigTrees.y[i], bigTrees.z[i]), 1.0f, leavesColor, BIG_TREE_ARCHETYPE, prop);
+        }
+        
+        const ItemStore &smallTrees = items[SMALL_TREE];
+        for (size_t i = 0; i < smallTrees.count(); i++) {
+            addTreeParts(itemParts, smallTrees.x[i], smallTrees.y[i], smallTrees.z[i], 2,
+                         biomes.foliageColorAt(smallTrees.x[i], smallTrees.z[i]));
+        }
+        
+        const ItemStore &rabbits = items[RABBIT];
+        for (size_t i = 0; i < rabbits.count(); i++) {
+            addRabbitParts(itemParts, 0.5f, rabbits.x[i], rabbits.y[i], rabbits.z[i], vec3(1.0f, 1.0f, 1.0f),
+                           rabbits.angle[i]);
+        }
+        
+        const ItemStore &squirrels = items[SQUIRREL];
+        for (size_t i = 0; i < squirrels.count(); i++) {
+            addSquirrelParts(itemParts, 0.5f, squirrels.x[i], squirrels.y[i], squirrels.z[i],
+                             vec3(0.5f, 0.3f, 0.4f), squirrels.angle[i]);
+        }
+        
+        const ItemStore &bushes = items[BUSH];
+        for (size_t i = 0; i < bushes.count(); i++) {
+            addBushParts(itemParts, bushes.x[i], bushes.y[i], bushes.z[i],
+                         biomes.bushColorAt(bushes.x[i], bushes.z[i]));
+        }
+    }
+    
+    // Parts of a random tree, returns its prop. Far away the slices are one box of their average width.
+    static uint32_t addRandomTreeParts(PartListBuilder &parts, const GeneratedTree &tree, vec3 leavesColor) {
+        uint32_t prop = parts.beginProp(PROP_RANDOM_TREE);
+        parts.add(PART_CUBE, PART_WOOD, false, tree.trunk, vec3(0.267f, 0.129f, 0.004f)); // Brown
+        float averageWidth = 0.0f;
+        for (const auto &leavesSlice: tree.leaves) {
+            parts.add(PART_CUBE, PART_LEAVES, true, leavesSlice, leavesColor, lodRange(0, 0));
+            averageWidth += length(vec3(leavesSlice[0])) / static_cast<float>(tree.leaves.size());
+        }
+        
+        // The slices are one unit high and stacked
+        float sliceCount = static_cast<float>(tree.leaves.size());
+        vec3 canopyCenter = vec3(tree.leaves.front()[3]) + vec3(0.0f, (sliceCount - 1.0f) / 2.0f, 0.0f);
+        parts.add(PART_CUBE, PART_LEAVES, true,
+                  translate(mat4(1.0f), canopyCenter) * scale(mat4(1.0f), vec3(averageWidth, sliceCount, averageWidth)),
+                  leavesColor, lodRange(1, 1));
+        return prop;
+    }
+    
+    // Impostor of a tree standing at base, its archetype scaled by scaling
+    void addImpostor(vec3 base, float scaling, vec3 color, uint32_t archetype, uint32_t prop) {
+        const ImpostorShape &shape = treeImpostors().shape(archetype);
+        impostors.push_back(
+                TreeImpostor{base + shape.center * scaling, shape.radius * scaling, color, archetype, prop});
+    }
+    
+    // The library of tree impostors, shared by all chunks. The atlases are baked by the workers as chunks need them.
+    static ImpostorLibrary &treeImpostors() {
+        static ImpostorLibrary library([]() {
+            vector<ImpostorShape> shapes;
+            vector<PartInstance> shapeInstances;
+            vector<PartBatch> shapeBatches;
+            
+            PartListBuilder bigTree;
+            addTreeParts(bigTree, 0.0f, 0.0f, 0.0f, 1, vec3(1.0f));
+            bigTree.build(shapeInstances, shapeBatches, 0);
+            shapes.emplace_back(shapeInstances);
+            
+            for (uint32_t i = 0; i < RANDOM_TREE_ARCHETYPE_COUNT; i++) {
+                GeneratedTree tree(WorldRandom(TREE_ARCHETYPE_SEED, ChunkCoord{0, 0}, i), 0.0f, 0.0f,
+                                   ITEM_SIZES[RANDOM_TREE]);
+                tree.generateTree(WorldRandom(TREE_ARCHETYPE_SEED, ChunkCoord{0, 0}, i, TREE_SHAPE_STREAM));
+                PartListBuilder randomTree;
+                addRandomTreeParts(randomTree, tree, vec3(1.0f));
+                randomTree.build(shapeInstances, shapeBatches, 0);
+                shapes.emplace_back(shapeInstances);
+            }
+            return shapes;
+        }());
+        return library;
+    }
+    
+    // The random tree archetype closest in height and width, relative to the tree's size
+    static uint32_t closestRandomTreeArchetype(float height, float width) {
+        uint32_t closest = 1;
+        float closestDistance = INFINITY;
+        for (uint32_t archetype = 1; archetype <= RANDOM_TREE_ARCHETYPE_COUNT; archetype++) {
+            const ImpostorShape &shape = treeImpostors().shape(archetype);
+            float dh = (shape.height - height) / height;
+            float dw = (shape.width - width) / width;
+            if (dh * dh + dw * dw < closestDistance) {
+                closestDistance = dh * dh + dw * dw;
+                closest = archetype;
+            }
+        }
+        return closest;
+    }
+    
+    [[nodiscard]] mat4 getGroundMatrix() const {
+        return groundMatrix(chunkPositionX, chunkPositionZ);
+    }
+    
+    [[nodiscard]] mat4 getRoadMatrix() const {
+        return roadMatrix(chunkPositionZ);
+    }
+    
+    // The static versions are used to draw bare ground for chunks that are still being generated
+    static float positionXForColumn(int column) {
+        return static_cast<float>(100 * column);
+    }
+    
+    static float positionZForID(int chunkPositionID) {
+        return static_cast<float>((100 * chunkPositionID) + 50);
+    }
+    
+    // Chunk under a world position
+    static ChunkCoord coordAt(float x, float z) {
+        return ChunkCoord{static_cast<int>(std::floor((x + 50) / 100)), static_cast<int>(std::floor((z - 50) / 100))};
+    }
+    
+    // The road only runs through the middle column of chunks
+    static bool hasRoad(ChunkCoord chunkCoord) {
+        return chunkCoord.x == 0;
+    }
+    
+    static mat4 groundMatrix(float chunkPositionX, float chunkPositionZ) {
+        return translate(mat4(1.0f), vec3(chunkPositionX, -0.3f, chunkPositionZ)) *
+               scale(mat4(1.0f), vec3(100.0f, 0.1f, 100.0f));
+    }
+    
+    static mat4 roadMatrix(float chunkPositionZ) {
+        return translate(mat4(1.0f), vec3(0.0f, -0.1f, chunkPositionZ)) *
+               scale(mat4(1.0f), vec3(10.0f, 0.3f, 100.0f));
+    }
+};
+
+#endif //PROCEDURALWORLD_WORLD_H
@@ -0,0 +1,63 @@
+#ifndef PROCEDURALWORLD_WORLD_RANDOM_H
+#define PROCEDURALWORLD_WORLD_RANDOM_H
+
+#include "chunk_coord.h"
+
+#include <cstdint>
+
+// Seed of the whole world, every generated chunk is derived from it. It has to be set before the first chunk is
+// requested from the workers, so that all of them see the same value.
+inline uint64_t worldSeed = 371;
+
+inline void setWorldSeed(uint64_t seed) {
+    worldSeed = seed;
+}
+
+inline uint64_t getWorldSeed() {
+    return worldSeed;
+}
+
+// SplitMix64 finalizer, turns any 64-bit input into a well mixed 64-bit output
+inline uint64_t splitMix64(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+// Counter-based random generator for world generation. The stream is fully determined by the key
+// (seed, chunk, itemIndex, stream), the n-th number is just a hash of the key and n. There is no hidden
+// state to share, so any item can be generated on any thread and the same seed always gives the same world.
+class WorldRandom {
+public:
+    // The stream separates independent uses of the same item (eg: its position and the shape of its tree)
+    // The road column (chunk.x = 0) keeps the streams it had when the world was a single row of chunks
+    WorldRandom(uint64_t seed, ChunkCoord chunk, uint32_t itemIndex, uint32_t stream = 0) {
+        uint64_t chunkAndItem = (static_cast<uint64_t>(static_cast<uint32_t>(chunk.z)) << 32) | itemIndex;
+        uint64_t columnAndStream = (static_cast<uint64_t>(static_cast<uint32_t>(chunk.x)) << 32) | stream;
+        key = splitMix64(seed ^ splitMix64(chunkAndItem ^ splitMix64(columnAndStream)));
+    }
+
+    uint64_t next() {
+        return splitMix64(key + 0x9E3779B97F4A7C15ull * counter++);
+    }
+
+    // Uniform float in [min, max)
+    float nextFloat(float min, float max) {
+        // The top 24 bits fill the whole float mantissa
+        float unit = static_cast<float>(next() >> 40) * (1.0f / 16777216.0f);
+        return min + (max - min) * unit;
+    }
+
+    // Uniform int in [min, max], both ends included like uniform_int_distribution
+    int nextInt(int min, int max) {
+        uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(max) - min) + 1;
+        return min + static_cast<int>(next() % range);
+    }
+
+private:
+    uint64_t key;
+    uint64_t counter = 0;
+};
+
+#endif //PROCEDURALWORLD_WORLD_RANDOM_H